@@ -0,0 +1,123 @@
+// Wire (I2C) and SPI mocks: register devices, NACK status, chip select
+// dispatch and the transaction log. Run with:
+//   src/build-and-run.sh examples/mocks
+
+#include <yatest/TestSuite.h>
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+
+namespace {
+  // Device which NACKs every transmission, e.g. a busy EEPROM.
+  class BusyDevice : public I2cDevice {
+  public:
+    bool write(const uint8_t*, std::size_t) override { return false; }
+    std::size_t read(uint8_t*, std::size_t) override { return 0; }
+  };
+
+  void check(bool condition, const std::string& message) {
+    if (!condition) {
+      throw std::runtime_error(message);
+    }
+  }
+
+  void writeRegisters(uint8_t address, std::initializer_list<uint8_t> bytes) {
+    Wire.beginTransmission(address);
+    for (uint8_t byte : bytes) {
+      Wire.write(byte);
+    }
+    check(Wire.endTransmission() == 0, "the transmission should be acknowledged");
+  }
+
+  uint8_t spiRead(int csPin, uint8_t reg) {
+    digitalWrite(csPin, LOW);
+    SPI.transfer(static_cast<uint8_t>(reg | 0x80));
+    uint8_t value = SPI.transfer(0);
+    digitalWrite(csPin, HIGH);
+    return value;
+  }
+
+  static const yatest::TestSuite& WireSuite =
+    yatest::suite("Wire")
+        .beforeEach([]() {
+          clearBusLog();
+          startBusLog();
+        })
+        .afterEach([]() {
+          stopBusLog();
+          clearBusLog();
+          Wire.detachAllDevices();
+        })
+        .tests("register writes and reads auto increment", []() {
+          I2cRegisterDevice sensor {};
+          Wire.attachDevice(0x40, sensor);
+          writeRegisters(0x40, { 0x10, 1, 2, 3 });
+          check(sensor.registers[0x10] == 1 && sensor.registers[0x12] == 3, "bytes should go to consecutive registers");
+          writeRegisters(0x40, { 0x11 });
+          check(Wire.requestFrom(0x40, 3) == 3u, "the request should return all bytes");
+          check(Wire.read() == 2 && Wire.read() == 3 && Wire.read() == 0, "reads should start at the register pointer");
+          check(Wire.read() == -1, "no more bytes should be available");
+          check(Wire.requestFrom(0x40, 1) == 1u && Wire.read() == 0, "the pointer should continue after the last read");
+          writeRegisters(0x40, { 0xfe, 7, 8, 9 });
+          check(sensor.registers[0xff] == 8 && sensor.registers[0x00] == 9, "the pointer should wrap around after 0xff");
+        })
+        .tests("missing and busy devices NACK", []() {
+          BusyDevice busy {};
+          Wire.attachDevice(0x50, busy);
+          Wire.beginTransmission(0x41);
+          Wire.write(static_cast<uint8_t>(0x10));
+          check(Wire.endTransmission() == 2, "a missing device should NACK the address");
+          Wire.beginTransmission(0x50);
+          Wire.write(static_cast<uint8_t>(0x10));
+          check(Wire.endTransmission() == 3, "a device rejecting the data should NACK the data");
+          check(Wire.requestFrom(0x41, 2) == 0u && Wire.available() == 0, "a request from a missing device should return nothing");
+          check(getBusLogSize() == 3u, "all transactions should be logged");
+          check(getBusTransaction(0).status == 2 && getBusTransaction(1).status == 3 && getBusTransaction(2).status == 2,
+                "the log should have the statuses");
+          check(getBusTransaction(1).address == 0x50 && getBusTransactionSent(getBusTransaction(1))[0] == 0x10,
+                "the log should have the address and the sent bytes");
+        });
+
+  static const yatest::TestSuite& SpiSuite =
+    yatest::suite("SPI")
+        .beforeEach([]() {
+          clearBusLog();
+          startBusLog();
+        })
+        .afterEach([]() {
+          stopBusLog();
+          clearBusLog();
+          SPI.detachAllDevices();
+        })
+        .tests("transfers go to the selected device", []() {
+          SpiRegisterDevice first {};
+          SpiRegisterDevice second {};
+          first.registers[0x0f] = 0x33;
+          second.registers[0x0f] = 0x44;
+          SPI.attachDevice(10, first);
+          SPI.attachDevice(9, second);
+          digitalWrite(10, HIGH);
+          digitalWrite(9, HIGH);
+          check(spiRead(10, 0x0f) == 0x33, "the first device should answer on its chip select");
+          check(spiRead(9, 0x0f) == 0x44, "the second device should answer on its chip select");
+          check(SPI.transfer(0x8f) == 0xff, "without a selected device the bus should read 0xff");
+          check(getBusLogSize() == 5u, "all transfers should be logged");
+          check(getBusTransaction(0).address == 10 && getBusTransaction(2).address == 9, "transfers should be logged with the chip select");
+          check(getBusTransaction(4).address == static_cast<uint16_t>(NOT_A_PIN), "transfers without a device should be logged with NOT_A_PIN");
+          check(getBusTransactionReceived(getBusTransaction(3))[0] == 0x44, "the log should have the received bytes");
+        })
+        .tests("register writes address consecutive registers", []() {
+          SpiRegisterDevice device {};
+          SPI.attachDevice(10, device);
+          digitalWrite(10, LOW);
+          uint8_t bytes[] = { 0x20, 0x0a, 0x0b };
+          SPI.transfer(bytes, sizeof(bytes));
+          digitalWrite(10, HIGH);
+          check(device.registers[0x20] == 0x0a && device.registers[0x21] == 0x0b, "bytes should go to consecutive registers");
+          check(bytes[1] == 0xff, "writes should read 0xff");
+          check(spiRead(10, 0x21) == 0x0b, "a read should return the written register");
+        });
+}
@@ -0,0 +1,76 @@
+// PROGMEM data and PSTR()/F() strings in inline functions, templates and
+// ordinary functions of one source, read through pgm_read_*() and the *_P()
+// functions. Run with and without --progmem:
+//   src/build-and-run.sh examples/mocks --progmem
+
+#include <yatest/TestSuite.h>
+#include <Arduino.h>
+#include <WString.h>
+#include <stdexcept>
+#include <string>
+
+namespace {
+  const char Greeting[] PROGMEM = "hello";
+  const uint16_t Table[] PROGMEM = { 1u, 20u, 300u, 4000u };
+
+  // Like a header of a library: F() and PSTR() in inline and template functions
+  inline String header() {
+    return String(F("header"));
+  }
+
+  inline const char* inlineText() {
+    return PSTR("inline");
+  }
+
+  template<typename T>
+  const char* templateText() {
+    return PSTR("template");
+  }
+
+  const char* plainText() {
+    return PSTR("plain");
+  }
+
+  void check(bool condition, const std::string& message) {
+    if (!condition) {
+      throw std::runtime_error(message);
+    }
+  }
+
+  static const yatest::TestSuite& ProgmemSuite =
+    yatest::suite("PROGMEM")
+        .tests("PROGMEM data is read with pgm_read_*() and strcpy_P()", []() {
+          char buffer[8];
+          strcpy_P(buffer, Greeting);
+          check(std::string(buffer) == "hello", "strcpy_P() should copy the string");
+          check(pgm_read_byte(&Greeting[1]) == 'e', "pgm_read_byte() should read the byte");
+          check(pgm_read_word(&Table[3]) == 4000u, "pgm_read_word() should read the word");
+          check(strlen_P(Greeting) == 5u, "strlen_P() should count the characters");
+        })
+        .tests("F() and PSTR() in inline, template and plain functions", []() {
+          check(header() == "header", "F() in an inline function should give the string");
+          char buffer[16];
+          strcpy_P(buffer, inlineText());
+          check(std::string(buffer) == "inline", "PSTR() in an inline function should be readable");
+          strcpy_P(buffer, templateText<int>());
+          check(std::string(buffer) == "template", "PSTR() in a template should be readable");
+          check(pgm_read_byte(plainText() + 4) == 'n', "PSTR() in a plain function should be readable");
+          check(strcmp_P("plain", plainText()) == 0, "strcmp_P() should compare with the flash string");
+        })
+#if defined(YATEST_PROGMEM_SECTION) && defined(__ELF__)
+        .tests("RAM data read as PROGMEM throws", []() {
+          static const char ram[] = "ram";
+          bool thrown = false;
+          try {
+            (void)pgm_read_byte(ram);
+          } catch (const std::logic_error&) {
+            thrown = true;
+          }
+          check(thrown, "pgm_read_byte() of RAM data should throw");
+        })
+#endif
+        .tests("FPSTR() of PROGMEM data prints", []() {
+          String text { FPSTR(Greeting) };
+          check(text == "hello", "FPSTR() should give the PROGMEM string");
+        });
+}
@@ -0,0 +1,136 @@
+// EEPROM and NOR flash mocks: program/erase semantics, wear counters and
+// image files. Run with:
+//   src/build-and-run.sh examples/mocks
+
+#include <yatest/TestSuite.h>
+#include <EEPROM.h>
+#include <StorageMock.h>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+namespace {
+  struct Settings {
+    uint16_t interval;
+    uint8_t mode;
+    uint8_t flags;
+  };
+
+  void check(bool condition, const std::string& message) {
+    if (!condition) {
+      throw std::runtime_error(message);
+    }
+  }
+
+  std::string imagePath(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+  }
+
+  static const yatest::TestSuite& FlashSuite =
+    yatest::suite("FlashMock")
+        .tests("programming only clears bits", []() {
+          FlashMock flash { 4096, 1024 };
+          const uint8_t first[] = { 0xf0, 0x0f };
+          const uint8_t second[] = { 0xcc, 0xcc };
+          check(flash.program(10, first, sizeof(first)), "program() should succeed");
+          check(flash.program(10, second, sizeof(second)), "programming again should succeed");
+          check(flash.data()[10] == 0xc0 && flash.data()[11] == 0x0c, "programming should AND the bytes");
+          check(flash.getProgramErrorCount() == 1u, "setting bits again should count a program error");
+          check(flash.getBytesProgrammed() == 4u, "programmed bytes should be counted");
+          check(!flash.program(4095, first, sizeof(first)), "programming past the end should fail");
+        })
+        .tests("erasing sets whole sectors to 0xff", []() {
+          FlashMock flash { 4096, 1024 };
+          const uint8_t zeros[8] {};
+          flash.program(1020, zeros, sizeof(zeros));
+          check(flash.getProgramCount(0) == 1u && flash.getProgramCount(1) == 1u, "a program across sectors should count for both");
+          check(flash.erase(1024, 2048), "erasing aligned sectors should succeed");
+          check(flash.data()[1020] == 0x00 && flash.data()[1024] == 0xff, "only the erased sectors should be 0xff");
+          check(!flash.erase(100, 1024), "erasing an unaligned range should fail");
+          check(!flash.eraseSector(4), "erasing a sector past the end should fail");
+          flash.eraseSector(1);
+          check(flash.getEraseCount(1) == 2u && flash.getEraseCount(2) == 1u, "erases should be counted per sector");
+          check(flash.getMaxEraseCount() == 2u && flash.getTotalEraseCount() == 3u, "erase totals should add up");
+          flash.resetCounters();
+          check(flash.getTotalEraseCount() == 0u && flash.getBytesProgrammed() == 0u, "resetCounters() should clear the counters");
+        })
+        .tests("a sector size of 0 throws", []() {
+          bool thrown = false;
+          try {
+            FlashMock flash { 4096, 0 };
+          } catch (const std::invalid_argument&) {
+            thrown = true;
+          }
+          check(thrown, "the constructor should throw std::invalid_argument");
+        })
+        .tests("flash image files keep their content", []() {
+          std::string path = imagePath("yatest-flash.img");
+          std::remove(path.c_str());
+          {
+            FlashMock flash { path.c_str(), 8192, 4096 };
+            check(flash.data()[0] == 0xff && flash.data()[8191] == 0xff, "a new image should be erased");
+            const uint8_t data[] = { 1, 2, 3 };
+            flash.program(4096, data, sizeof(data));
+          }
+          check(std::filesystem::file_size(path) == 8192u, "the image should have the flash size");
+          {
+            FlashMock flash { path.c_str(), 8192, 4096 };
+            check(flash.data()[4097] == 2, "the image should keep programmed data");
+            check(flash.getTotalEraseCount() == 0u, "counters should start at 0 for a mapped image");
+          }
+          std::remove(path.c_str());
+        });
+
+  static const yatest::TestSuite& EepromSuite =
+    yatest::suite("EEPROM")
+        .beforeEach([]() {
+          resetEepromMock(512);
+        })
+        .tests("starts erased with the given size", []() {
+          check(EEPROM.length() == 512u, "length() should be the reset size");
+          check(EEPROM.read(0) == 0xff && EEPROM[511] == 0xff, "cells should start erased");
+          check(EEPROM.read(512) == 0xff && EEPROM.read(-1) == 0xff, "reads out of range should give 0xff");
+          EEPROM.write(512, 1);
+          check(getEepromWriteCount() == 0u, "writes out of range should be ignored");
+        })
+        .tests("put() and get() round trip and only write changed bytes", []() {
+          Settings settings { 1000u, 2u, 0xffu };
+          EEPROM.put(16, settings);
+          check(getEepromWriteCount() == 3u, "put() should skip bytes which are already 0xff");
+          Settings read {};
+          EEPROM.get(16, read);
+          check(read.interval == 1000u && read.mode == 2u && read.flags == 0xffu, "get() should read what put() wrote");
+          settings.mode = 3u;
+          EEPROM.put(16, settings);
+          check(getEepromWriteCount() == 4u, "put() should only write the changed byte");
+          check(getEepromWriteCount(18) == 2u && getEepromWriteCount(16) == 1u, "writes should be counted per cell");
+        })
+        .tests("update() wears cells only on change", []() {
+          for (int i = 0; i < 100; ++i) {
+            EEPROM.update(7, static_cast<uint8_t>(i / 10));
+            EEPROM.write(8, static_cast<uint8_t>(i / 10));
+          }
+          check(getEepromWriteCount(7) == 10u, "update() should write only changed values");
+          check(getEepromWriteCount(8) == 100u, "write() should always write");
+          check(getEepromMaxWriteCount() == 100u, "the maximum should be the most written cell");
+          EEPROM[9].update(5);
+          EEPROM[9] = 5;
+          check(getEepromWriteCount(9) == 2u && EEPROM[9] == 5, "EERef should write through the mock");
+        })
+        .tests("EEPROM image files keep their content", []() {
+          std::string path = imagePath("yatest-eeprom.img");
+          std::remove(path.c_str());
+          check(openEepromImage(path.c_str(), 256), "the image should be mapped");
+          check(EEPROM.length() == 256u && EEPROM.read(255) == 0xff, "a new image should be erased");
+          EEPROM.write(3, 42);
+          EEPROM.begin(512);
+          check(EEPROM.length() == 256u, "begin() should keep a mapped image");
+          resetEepromMock(512);
+          check(EEPROM.read(3) == 0xff, "a reset should unmap the image");
+          check(openEepromImage(path.c_str(), 256), "the image should be mapped again");
+          check(EEPROM.read(3) == 42 && getEepromWriteCount() == 0u, "the image should keep the content, not the counters");
+          resetEepromMock(512);
+          std::remove(path.c_str());
+        });
+}
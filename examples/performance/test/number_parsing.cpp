@@ -0,0 +1,141 @@
+// Cost of parsing a million numbers with Stream::parseInt()/parseFloat() (from
+// a stream with a peek buffer and from one which only has read()/peek()) and
+// String::toInt()/toFloat(). Run with
+//   src/build-and-run.sh examples/performance --profile release --no-cache
+// and compare the reported durations between versions.
+
+#include <yatest/TestSuite.h>
+#include <Stream.h>
+#include <WString.h>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+  constexpr int NUMBER_COUNT = 1000000;
+
+  // Numbers separated by spaces, with their sum to check the parsed values.
+  struct Corpus {
+    std::string text {};
+    std::vector<String> strings {};
+    double sum = 0.0;
+  };
+
+  Corpus Integers {};
+  Corpus Decimals {};
+
+  // Reads a corpus with read()/peek() only.
+  class CorpusStream : public Stream {
+  protected:
+    const std::string& _text;
+    size_t _position = 0u;
+
+  public:
+    explicit CorpusStream(const std::string& text) : _text(text) {}
+
+    int available() override { return static_cast<int>(_text.size() - _position); }
+    int read() override { return _position < _text.size() ? static_cast<unsigned char>(_text[_position++]) : -1; }
+    int peek() override { return _position < _text.size() ? static_cast<unsigned char>(_text[_position]) : -1; }
+    size_t write(uint8_t) override { return 0u; }
+    size_t write(const uint8_t*, size_t) override { return 0u; }
+  };
+
+  // Also gives direct access to the corpus, like streams with an internal buffer.
+  class BufferedCorpusStream : public CorpusStream {
+  public:
+    using CorpusStream::CorpusStream;
+
+    bool hasPeekBufferAPI() const override { return true; }
+    size_t peekAvailable() override { return _text.size() - _position; }
+    const char* peekBuffer() override { return _text.data() + _position; }
+    void peekConsume(size_t consume) override { _position += consume; }
+  };
+
+  void generate(Corpus& corpus, bool decimals) {
+    unsigned long random = 12345u;
+    char number[32];
+    corpus.text.reserve(NUMBER_COUNT * 10u);
+    corpus.strings.reserve(NUMBER_COUNT);
+    for (int i = 0; i < NUMBER_COUNT; ++i) {
+      random = random * 1103515245u + 12345u;
+      long value = static_cast<long>((random >> 8) % 2000000u) - 1000000;
+      if (decimals) {
+        std::snprintf(number, sizeof(number), "%s%ld.%03ld", value < 0 ? "-" : "", std::labs(value) / 1000, std::labs(value) % 1000);
+        corpus.sum += value / 1000.0;
+      } else {
+        std::snprintf(number, sizeof(number), "%ld", value);
+        corpus.sum += value;
+      }
+      corpus.text += number;
+      corpus.text += ' ';
+      corpus.strings.emplace_back(number);
+    }
+  }
+
+  void check(const Corpus& corpus, double sum) {
+    if (std::fabs(sum - corpus.sum) > 1e-3 * NUMBER_COUNT) {
+      throw std::runtime_error("parsed numbers should add up to the sum of the corpus");
+    }
+  }
+
+  // The stream is passed on as code under test gets it, as a Stream of
+  // unknown type, so the compiler cannot resolve the virtual calls.
+  double parseIntegers(Stream& corpus) {
+    Stream* volatile opaque = &corpus;
+    Stream& stream = *opaque;
+    double sum = 0.0;
+    for (int i = 0; i < NUMBER_COUNT; ++i) {
+      sum += stream.parseInt();
+    }
+    return sum;
+  }
+
+  double parseDecimals(Stream& corpus) {
+    Stream* volatile opaque = &corpus;
+    Stream& stream = *opaque;
+    double sum = 0.0;
+    for (int i = 0; i < NUMBER_COUNT; ++i) {
+      sum += stream.parseFloat();
+    }
+    return sum;
+  }
+
+  static const yatest::TestSuite& BenchmarkNumberParsing =
+    yatest::suite("Benchmark: number parsing")
+        .beforeAll([]() {
+          generate(Integers, false);
+          generate(Decimals, true);
+        })
+        .tests("parseInt() 1000000 numbers, peek buffer", []() {
+          BufferedCorpusStream stream { Integers.text };
+          check(Integers, parseIntegers(stream));
+        })
+        .tests("parseInt() 1000000 numbers, read()/peek()", []() {
+          CorpusStream stream { Integers.text };
+          check(Integers, parseIntegers(stream));
+        })
+        .tests("parseFloat() 1000000 numbers, peek buffer", []() {
+          BufferedCorpusStream stream { Decimals.text };
+          check(Decimals, parseDecimals(stream));
+        })
+        .tests("parseFloat() 1000000 numbers, read()/peek()", []() {
+          CorpusStream stream { Decimals.text };
+          check(Decimals, parseDecimals(stream));
+        })
+        .tests("String::toInt() 1000000 numbers", []() {
+          double sum = 0.0;
+          for (const String& number : Integers.strings) {
+            sum += number.toInt();
+          }
+          check(Integers, sum);
+        })
+        .tests("String::toFloat() 1000000 numbers", []() {
+          double sum = 0.0;
+          for (const String& number : Decimals.strings) {
+            sum += number.toFloat();
+          }
+          check(Decimals, sum);
+        });
+}
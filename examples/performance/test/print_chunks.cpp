@@ -0,0 +1,106 @@
+// Cost of Print::printf()/format() to a sink with a bulk write, like a serial
+// port or a network client, and check that the output arrives in chunks (one
+// write per literal run or conversion) instead of one write per byte. Run with
+//   src/build-and-run.sh examples/performance --profile release --no-cache
+// and compare the reported durations between versions.
+
+#include <yatest/TestSuite.h>
+#include <Print.h>
+#include <WString.h>
+#include <stdexcept>
+#include <string>
+
+namespace {
+  constexpr int LINE_COUNT = 100000;
+
+  // Counts the writes it gets, per kind, like a sink whose every write costs.
+  class CountingSink : public Print {
+  public:
+    unsigned long byteWrites = 0u;
+    unsigned long bulkWrites = 0u;
+    unsigned long bytes = 0u;
+
+    size_t write(uint8_t) override {
+      byteWrites += 1u;
+      bytes += 1u;
+      return 1u;
+    }
+
+    size_t write(const uint8_t*, size_t size) override {
+      bulkWrites += 1u;
+      bytes += size;
+      return size;
+    }
+
+    using Print::write;
+  };
+
+  // The sink is passed on as code under test gets it, as a Print of unknown
+  // type, so the compiler cannot resolve the virtual calls.
+  Print& opaque(CountingSink& sink) {
+    Print* volatile print = &sink;
+    return *print;
+  }
+
+  void checkChunks(const CountingSink& sink, unsigned long bytes, unsigned long maxWrites) {
+    if (sink.bytes != bytes) {
+      throw std::runtime_error("the sink should get " + std::to_string(bytes) + " bytes, not " + std::to_string(sink.bytes));
+    }
+    if (sink.byteWrites + sink.bulkWrites > maxWrites) {
+      throw std::runtime_error("the output should arrive in at most " + std::to_string(maxWrites) + " writes, not "
+                               + std::to_string(sink.byteWrites) + " single byte and " + std::to_string(sink.bulkWrites) + " bulk writes");
+    }
+  }
+
+  static const yatest::TestSuite& BenchmarkPrintChunks =
+    yatest::suite("Benchmark: Print chunks")
+        .tests("printf() 1026 bytes arrives in chunks", []() {
+          CountingSink sink {};
+          std::string payload(1003u, 'x');
+          size_t written = opaque(sink).printf("payload %s (%d bytes)%c\n", payload.c_str(), 1003, '!');
+          // "payload ", payload, " (", "1003", " bytes)", "!", "\n"
+          checkChunks(sink, 1026u, 7u);
+          if (written != 1026u) {
+            throw std::runtime_error("printf() should return the number of bytes written");
+          }
+        })
+        .tests("format() 1026 bytes arrives in chunks", []() {
+          CountingSink sink {};
+          String payload { std::string(1003u, 'x').c_str() };
+          size_t written = opaque(sink).format("payload {} ({} bytes)!\n", payload, 1003);
+          // "payload ", payload, " (", "1003", " bytes)!\n"
+          checkChunks(sink, 1026u, 5u);
+          if (written != 1026u) {
+            throw std::runtime_error("format() should return the number of bytes written");
+          }
+        })
+        .tests("print()/println() numbers arrive in chunks", []() {
+          CountingSink sink {};
+          Print& print = opaque(sink);
+          print.print(-1234567890L);
+          print.println(3.25, 2);
+          // "-1234567890", "3.25", "\n"
+          checkChunks(sink, 16u, 3u);
+        })
+        .tests("printf() 100000 log lines", []() {
+          CountingSink sink {};
+          Print& print = opaque(sink);
+          for (int i = 0; i < LINE_COUNT; ++i) {
+            print.printf("[%8lu] %-8s sensor %d: %.2f C\n", 1000ul * i, "INFO", i % 16, 20.0 + (i % 100) / 10.0);
+          }
+          if (sink.byteWrites != 0u) {
+            throw std::runtime_error("the log lines should not be written byte by byte");
+          }
+        })
+        .tests("format() 100000 log lines", []() {
+          CountingSink sink {};
+          Print& print = opaque(sink);
+          String level { "INFO" };
+          for (int i = 0; i < LINE_COUNT; ++i) {
+            print.format("[{}] {} sensor {}: {} C\n", 1000ul * i, level, i % 16, 20.0 + (i % 100) / 10.0);
+          }
+          if (sink.byteWrites != 0u) {
+            throw std::runtime_error("the log lines should not be written byte by byte");
+          }
+        });
+}
@@ -0,0 +1,53 @@
+// Cost of registering and running many test cases, as done during static
+// initialization by large test suites. Run with
+//   src/build-and-run.sh examples/performance --profile release --no-cache
+// and compare the reported durations between versions.
+
+#include <yatest/TestSuite.h>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+  constexpr int TEST_COUNT = 10000;
+
+  int Counter = 0;
+
+  void registerTests(yatest::TestSuite& suite) {
+    for (int i = 0; i < TEST_COUNT; ++i) {
+      suite.tests("test", [i]() { Counter += i & 1; });
+    }
+  }
+
+  // Suite run by "run 10000 tests", registered in a fixture so the tests do
+  // not depend on each other (--shuffle). The arena is rewound afterwards, so
+  // repeated runs (--repeat) do not keep the registered tests.
+  yatest::detail::Arena::Mark FixtureMark {};
+  std::unique_ptr<yatest::TestSuite> Registered {};
+
+  static const yatest::TestSuite& BenchmarkRegistration =
+    yatest::suite("Benchmark: registration")
+        .beforeAll([]() {
+          FixtureMark = yatest::detail::arena().mark();
+          Registered = std::make_unique<yatest::TestSuite>("registered");
+          registerTests(*Registered);
+        })
+        .afterAll([]() {
+          Registered.reset();
+          yatest::detail::arena().rewind(FixtureMark);
+        })
+        .tests("register 10000 tests", []() {
+          yatest::detail::Arena::Mark mark = yatest::detail::arena().mark();
+          {
+            yatest::TestSuite suite { "registered" };
+            registerTests(suite);
+          }
+          yatest::detail::arena().rewind(mark);
+        })
+        .tests("run 10000 tests", []() {
+          Counter = 0;
+          auto result = Registered->run();
+          if (result.testResults().size() != TEST_COUNT || Counter != TEST_COUNT / 2) {
+            throw std::runtime_error("each test should have run once");
+          }
+        });
+}
@@ -0,0 +1,130 @@
+// Cost of the String operations used to parse and normalize commands: case
+// conversion and comparison, replace(), trim() and indexOf(), on a large text
+// and on many short strings. Run with
+//   src/build-and-run.sh examples/performance --profile release --no-cache
+// and compare the reported durations between versions.
+
+#include <yatest/TestSuite.h>
+#include <WString.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+  constexpr int TEXT_SIZE = 1 << 20;
+  constexpr int COMMAND_COUNT = 100000;
+  constexpr int REPEAT = 20;
+
+  std::string Text {};
+  std::vector<String> Commands {};
+  std::vector<String> UpperCommands {};
+
+  void generate() {
+    static const char* const words[] = { "Set", "GET", "status", "Reset", "led", "MODE", "value", "Temp" };
+    unsigned long random = 12345u;
+    Text.reserve(TEXT_SIZE);
+    while (Text.size() < static_cast<size_t>(TEXT_SIZE)) {
+      random = random * 1103515245u + 12345u;
+      Text += words[(random >> 8) % 8u];
+      Text += (random >> 16) % 16u == 0u ? '\n' : ' ';
+    }
+    Text.resize(TEXT_SIZE);
+    for (int i = 0; i < COMMAND_COUNT; ++i) {
+      std::string command = "  ";
+      for (int word = 0; word < 4; ++word) {
+        random = random * 1103515245u + 12345u;
+        command += words[(random >> 8) % 8u];
+        command += ' ';
+      }
+      command += std::to_string(i);
+      command += "\r\n";
+      Commands.emplace_back(command);
+      String upper { command };
+      upper.toUpperCase();
+      UpperCommands.push_back(upper);
+    }
+  }
+
+  static const yatest::TestSuite& BenchmarkStringKernels =
+    yatest::suite("Benchmark: String kernels")
+        .beforeAll([]() { generate(); })
+        .tests("toLowerCase()/toUpperCase() 20 x 1 MB", []() {
+          String text { Text };
+          for (int i = 0; i < REPEAT; ++i) {
+            text.toLowerCase();
+            text.toUpperCase();
+          }
+          if (text.length() != static_cast<unsigned>(TEXT_SIZE) || text.indexOf('s') >= 0) {
+            throw std::runtime_error("the text should be upper case");
+          }
+        })
+        .tests("replace(char, char) 20 x 1 MB", []() {
+          String text { Text };
+          for (int i = 0; i < REPEAT; ++i) {
+            text.replace('\n', ' ');
+            text.replace(' ', '\n');
+          }
+          if (text.indexOf(' ') >= 0) {
+            throw std::runtime_error("all spaces should be replaced");
+          }
+        })
+        .tests("indexOf(char) 20 x 1 MB", []() {
+          String text { Text };
+          int found = 0;
+          for (int i = 0; i < REPEAT; ++i) {
+            for (int index = text.indexOf('\n'); index >= 0; index = text.indexOf('\n', index + 1)) {
+              found += 1;
+            }
+          }
+          if (found == 0) {
+            throw std::runtime_error("the text should have line breaks");
+          }
+        })
+        .tests("indexOf(String) 20 x 1 MB", []() {
+          String text { Text };
+          String missing { "status Reset led MODE value Temp Set GET!" };
+          String present { "Temp\nSet" };
+          int found = 0;
+          for (int i = 0; i < REPEAT; ++i) {
+            if (text.indexOf(missing) >= 0) {
+              throw std::runtime_error("the text should not contain the pattern");
+            }
+            for (int index = text.indexOf(present); index >= 0; index = text.indexOf(present, index + 1)) {
+              found += 1;
+            }
+          }
+          if (found == 0) {
+            throw std::runtime_error("the text should contain the pattern");
+          }
+        })
+        .tests("indexOf(String) near matches 64 kB", []() {
+          // Every position matches all but the last byte of the pattern
+          String text { std::string(64u * 1024u, 'a') };
+          String pattern { std::string(256u, 'a') + "b" };
+          if (text.indexOf(pattern) >= 0) {
+            throw std::runtime_error("the text should not contain the pattern");
+          }
+        })
+        .tests("equalsIgnoreCase() 100000 commands", []() {
+          int equal = 0;
+          for (int i = 0; i < COMMAND_COUNT; ++i) {
+            equal += Commands[i].equalsIgnoreCase(UpperCommands[i]) ? 1 : 0;
+            equal -= Commands[i].equalsIgnoreCase(UpperCommands[(i + 1) % COMMAND_COUNT]) ? 1 : 0;
+          }
+          if (equal != COMMAND_COUNT) {
+            throw std::runtime_error("each command should only equal its upper case version");
+          }
+        })
+        .tests("trim()/toLowerCase() 100000 commands", []() {
+          unsigned long length = 0u;
+          for (const String& command : Commands) {
+            String normalized { command };
+            normalized.trim();
+            normalized.toLowerCase();
+            length += normalized.length();
+          }
+          if (length == 0u) {
+            throw std::runtime_error("the commands should not be empty");
+          }
+        });
+}
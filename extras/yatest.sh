@@ -29,4 +29,4 @@ if [ ! -f "$YATEST_DIR/src/build-and-run.sh" ]; then
     exit 1
 fi
 
-"$YATEST_DIR/src/build-and-run.sh" "$LIB_DIR"
+"$YATEST_DIR/src/build-and-run.sh" "$LIB_DIR" "$@"
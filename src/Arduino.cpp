@@ -1,42 +1,709 @@
 #include "Arduino.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <string>
+
+#if defined(__linux__)
+#include <link.h>
+#include <unistd.h>
+#endif
 
 unsigned long _test_millis = 0;
 unsigned long _test_micros = 0;
 
 namespace {
-    int pinModes[GPIO_MOCK_MAX_PINS];
-    int pinValues[GPIO_MOCK_MAX_PINS];
+    struct MockEvent {
+        unsigned long micros;
+        unsigned long long sequence; // Keeps events at the same time in FIFO order
+        std::function<void()> callback;
+
+        bool operator>(const MockEvent& other) const {
+            return micros != other.micros ? micros > other.micros : sequence > other.sequence;
+        }
+    };
+
+    std::priority_queue<MockEvent, std::vector<MockEvent>, std::greater<MockEvent>> mockEvents {};
+    unsigned long long mockEventSequence = 0u;
+    unsigned long microsSinceMillis = 0u; // Sub-millisecond part of advanced time
+
+    void setClock(unsigned long time) {
+        unsigned long delta = time - _test_micros;
+        _test_micros = time;
+        microsSinceMillis += delta % 1000u;
+        _test_millis += delta / 1000u + microsSinceMillis / 1000u;
+        microsSinceMillis %= 1000u;
+    }
+}
+
+void advanceMockTime(unsigned long microsDelta) {
+  unsigned long target = _test_micros + microsDelta;
+  while (!mockEvents.empty() && static_cast<long>(mockEvents.top().micros - target) <= 0) {
+    MockEvent event = mockEvents.top();
+    mockEvents.pop();
+    if (static_cast<long>(event.micros - _test_micros) > 0) {
+      setClock(event.micros);
+    }
+    event.callback();
+  }
+  if (static_cast<long>(target - _test_micros) > 0) {
+    setClock(target);
+  }
+}
+
+namespace {
+    std::vector<MockWaitSite> waitSites {};
+    std::size_t lastWaitSite = 0u; // Waits mostly repeat at the same site (loops)
+
+    struct SourceLocation {
+        std::string file;
+        int line;
+    };
+
+#if defined(__linux__)
+    struct LoadedObject {
+        uintptr_t address;
+        uintptr_t bias;
+        std::string path;
+    };
+
+    int findLoadedObject(dl_phdr_info* info, size_t, void* data) {
+        LoadedObject& object = *static_cast<LoadedObject*>(data);
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr)& segment = info->dlpi_phdr[i];
+            uintptr_t begin = info->dlpi_addr + segment.p_vaddr;
+            if (segment.p_type == PT_LOAD && object.address >= begin && object.address < begin + segment.p_memsz) {
+                object.bias = info->dlpi_addr;
+                object.path = info->dlpi_name != nullptr ? info->dlpi_name : "";
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // File and line of a code address from the debug information, looked up
+    // with addr2line.
+    SourceLocation lookUpSourceLocation(const void* address) {
+        // A return address follows the call, which may end the line
+        LoadedObject object { reinterpret_cast<uintptr_t>(address) - 1u, 0u, {} };
+        if (address == nullptr || dl_iterate_phdr(findLoadedObject, &object) == 0) {
+            return SourceLocation { "", 0 };
+        }
+        if (object.path.empty()) {
+            // The executable itself, which has no name in the list
+            char executable[4096];
+            ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1u);
+            object.path.assign(executable, length > 0 ? length : 0);
+        }
+        std::string path {};
+        for (char c : object.path) {
+            path += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        }
+        char offset[32];
+        std::snprintf(offset, sizeof(offset), "%#lx", static_cast<unsigned long>(object.address - object.bias));
+        std::string command = "addr2line -e '" + path + "' " + offset + " 2>/dev/null";
+        std::FILE* output = popen(command.c_str(), "r");
+        if (output == nullptr) {
+            return SourceLocation { "", 0 };
+        }
+        char text[4096] = "";
+        bool read = std::fgets(text, sizeof(text), output) != nullptr;
+        pclose(output);
+        // "<file>:<line>", optionally followed by " (discriminator <n>)"
+        char* colon = read ? std::strrchr(text, ':') : nullptr;
+        int line = colon != nullptr ? std::atoi(colon + 1) : 0;
+        if (line <= 0) {
+            return SourceLocation { "", 0 };
+        }
+        return SourceLocation { std::string(text, colon), line };
+    }
+#else
+    SourceLocation lookUpSourceLocation(const void*) {
+        return SourceLocation { "", 0 };
+    }
+#endif
+
+    // Looked up once per address, only when the profile is read
+    const SourceLocation& sourceLocation(const void* address) {
+        static std::map<const void*, SourceLocation> locations {};
+        auto location = locations.find(address);
+        if (location == locations.end()) {
+            location = locations.emplace(address, lookUpSourceLocation(address)).first;
+        }
+        return location->second;
+    }
+}
+
+void waitMockTime(unsigned long micros, const char* kind, MockCallSite site) {
+  if (lastWaitSite >= waitSites.size() || waitSites[lastWaitSite].address != site.address || waitSites[lastWaitSite].kind != kind) {
+    lastWaitSite = 0u;
+    while (lastWaitSite < waitSites.size() && (waitSites[lastWaitSite].address != site.address ||
+           std::strcmp(waitSites[lastWaitSite].kind, kind) != 0)) {
+      lastWaitSite += 1u;
+    }
+    if (lastWaitSite == waitSites.size()) {
+      waitSites.push_back(MockWaitSite { kind, site.address, "", 0, 0u, 0u });
+    }
+  }
+  waitSites[lastWaitSite].micros += micros;
+  waitSites[lastWaitSite].calls += 1u;
+  advanceMockTime(micros);
+}
+
+std::vector<MockWaitSite> getMockWaitProfile() {
+  std::vector<MockWaitSite> sites = waitSites;
+  for (MockWaitSite& site : sites) {
+    const SourceLocation& location = sourceLocation(site.address);
+    site.file = location.file.c_str();
+    site.line = location.line;
+  }
+  std::stable_sort(sites.begin(), sites.end(), [](const MockWaitSite& a, const MockWaitSite& b) { return a.micros > b.micros; });
+  return sites;
+}
+
+void resetMockWaitProfile() {
+  waitSites.clear();
+  lastWaitSite = 0u;
+}
+
+YATEST_MOCK_NOINLINE void delay(unsigned long ms) {
+  countMockCall(MockCall::Delay);
+  _mock_delay_micros += ms * 1000u;
+  waitMockTime(ms * 1000u, "delay", YATEST_MOCK_CALLER);
+}
+
+YATEST_MOCK_NOINLINE void delayMicroseconds(unsigned int us) {
+  countMockCall(MockCall::Delay);
+  _mock_delay_micros += us;
+  waitMockTime(us, "delayMicroseconds", YATEST_MOCK_CALLER);
+}
+
+void scheduleMockEvent(unsigned long atMicros, std::function<void()> callback) {
+  mockEvents.push(MockEvent { atMicros, mockEventSequence++, std::move(callback) });
+}
+
+std::size_t getPendingMockEventCount() {
+  return mockEvents.size();
+}
+
+void clearMockEvents() {
+  mockEvents = {};
+}
+
+unsigned long long _mock_call_counts[MOCK_CALL_KINDS] = {};
+unsigned long long _mock_delay_micros = 0u;
+
+// Cycles per call (pinMode, digitalWrite, digitalRead, analogRead, analogWrite,
+// Print byte, Stream byte, String operation, delay call) are rough figures of
+// the respective Arduino cores, analogRead including the conversion.
+const BoardProfile BOARD_GENERIC { "Generic", GPIO_MOCK_MAX_PINS, 0xffffffffu, sizeof(int) * 8u, sizeof(long) * 8u, sizeof(double) * 8u,
+    0u, { 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u } };
+const BoardProfile BOARD_UNO { "Arduino Uno", 20u, bit(INPUT) | bit(OUTPUT) | bit(INPUT_PULLUP), 16u, 32u, 32u,
+    16000000u, { 70u, 60u, 55u, 1800u, 80u, 90u, 40u, 250u, 30u } };
+const BoardProfile BOARD_MEGA { "Arduino Mega 2560", 70u, bit(INPUT) | bit(OUTPUT) | bit(INPUT_PULLUP), 16u, 32u, 32u,
+    16000000u, { 75u, 65u, 60u, 1800u, 85u, 90u, 40u, 250u, 30u } };
+const BoardProfile BOARD_ESP32 { "ESP32", 40u, bit(INPUT) | bit(OUTPUT) | bit(INPUT_PULLUP) | bit(INPUT_PULLDOWN) | bit(OUTPUT_OPENDRAIN), 32u, 32u, 64u,
+    240000000u, { 600u, 60u, 50u, 2400u, 1500u, 300u, 150u, 400u, 100u } };
+const BoardProfile BOARD_RP2040 { "RP2040", 30u, bit(INPUT) | bit(OUTPUT) | bit(INPUT_PULLUP) | bit(INPUT_PULLDOWN) | bit(OUTPUT_OPENDRAIN), 32u, 32u, 64u,
+    133000000u, { 200u, 40u, 30u, 270u, 200u, 200u, 100u, 300u, 50u } };
+
+const char* getMockCallName(MockCall call) {
+  switch (call) {
+  case MockCall::PinMode: return "pinMode";
+  case MockCall::DigitalWrite: return "digitalWrite";
+  case MockCall::DigitalRead: return "digitalRead";
+  case MockCall::AnalogRead: return "analogRead";
+  case MockCall::AnalogWrite: return "analogWrite";
+  case MockCall::PrintWrite: return "Print::write";
+  case MockCall::StreamRead: return "Stream::read";
+  case MockCall::StringOp: return "String";
+  case MockCall::Delay: return "delay";
+  }
+  return "";
+}
+
+void resetMockCallCounts() {
+  std::fill(std::begin(_mock_call_counts), std::end(_mock_call_counts), 0u);
+  _mock_delay_micros = 0u;
+}
+
+namespace {
+    const BoardProfile* board = &BOARD_GENERIC;
+
+    GpioSnapshot emptyGpioState(std::size_t pinCount) {
+        std::size_t words = (pinCount + 63u) / 64u;
+        GpioSnapshot state {};
+        state.values.assign(words, 0u);
+        state.configured.assign(words, 0u);
+        for (auto& plane : state.modes) {
+            plane.assign(words, 0u);
+        }
+        return state;
+    }
+
+    inline bool getBit(const std::vector<uint64_t>& bits, int pin) {
+        return (bits[pin >> 6] >> (pin & 63)) & 1u;
+    }
+
+    inline void setBit(std::vector<uint64_t>& bits, int pin, bool value) {
+        uint64_t mask = uint64_t(1u) << (pin & 63);
+        if (value) {
+            bits[pin >> 6] |= mask;
+        } else {
+            bits[pin >> 6] &= ~mask;
+        }
+    }
+
+    unsigned long unsignedToWidth(unsigned long value, unsigned bits) {
+        return bits >= sizeof(long) * 8u ? value : value & ((1ul << bits) - 1u);
+    }
+
+    long signedToWidth(long value, unsigned bits) {
+        if (bits >= sizeof(long) * 8u) {
+            return value;
+        }
+        unsigned long truncated = unsignedToWidth(static_cast<unsigned long>(value), bits);
+        unsigned long sign = 1ul << (bits - 1u);
+        return static_cast<long>((truncated ^ sign) - sign);
+    }
+
+    // Pin state is constructed on first use (not by a global initializer), so
+    // the mocks also work from constructors of globals in other sources.
+    GpioSnapshot& gpio() {
+        static GpioSnapshot state = emptyGpioState(GPIO_MOCK_MAX_PINS);
+        return state;
+    }
+
     std::size_t digitalWriteCalls = 0u;
+    std::size_t invalidGpioCalls = 0u;
     int lastDigitalWritePin = NOT_A_PIN;
     int lastDigitalWriteValue = 0;
     int lastPinModePin = NOT_A_PIN;
     int lastPinModeMode = 0;
+
+    inline bool isPin(int pin) {
+        return pin >= 0 && static_cast<std::size_t>(pin) < board->pinCount;
+    }
+
+    // Pin check of the Arduino API, counting invalid pins used by the code under test.
+    inline bool isValidPin(int pin) {
+        if (isPin(pin)) {
+            return true;
+        }
+        invalidGpioCalls += 1u;
+        return false;
+    }
+
+    struct Stimulus {
+        enum struct Kind { None, SquareWave, Levels, Callback } kind = Kind::None;
+        unsigned long period = 0u;
+        unsigned long high = 0u;
+        unsigned long phase = 0u;
+        std::vector<GpioLevelChange> changes {};
+        int initialValue = LOW;
+        std::function<int(unsigned long)> callback {};
+
+        int valueAt(unsigned long time) const {
+            switch (kind) {
+            case Kind::SquareWave:
+                if (time < phase || period == 0u) return LOW;
+                return (time - phase) % period < high ? HIGH : LOW;
+            case Kind::Levels: {
+                auto next = std::upper_bound(changes.begin(), changes.end(), time,
+                    [](unsigned long t, const GpioLevelChange& change) { return t < change.micros; });
+                return next == changes.begin() ? initialValue : std::prev(next)->value;
+            }
+            case Kind::Callback:
+                return callback(time);
+            case Kind::None:
+                break;
+            }
+            return LOW;
+        }
+    };
+
+    std::vector<Stimulus>& stimuli() {
+        static std::vector<Stimulus> pins(GPIO_MOCK_MAX_PINS);
+        return pins;
+    }
+
+    // Analog, tone and interrupt state of a pin.
+    struct PinIo {
+        int analogReadValue = 0;
+        std::function<int(unsigned long)> analogReadCallback {};
+        int analogWriteValue = -1;
+        unsigned int toneFrequency = 0u;
+        unsigned long toneGeneration = 0u; // Invalidates a scheduled tone end
+        void (*isr)() = nullptr;
+        int interruptMode = CHANGE;
+        bool interruptPending = false;
+        std::size_t interruptCount = 0u;
+        unsigned long edgeGeneration = 0u; // Invalidates a scheduled stimulus edge
+    };
+
+    std::vector<PinIo>& pinIo() {
+        static std::vector<PinIo> pins(GPIO_MOCK_MAX_PINS);
+        return pins;
+    }
+
+    struct DigitalWriteObserver {
+        std::size_t id;
+        int pin;
+        std::function<void(int)> observer;
+    };
+
+    std::vector<DigitalWriteObserver> digitalWriteObservers {};
+    std::size_t nextDigitalWriteObserverId = 1u;
+    int analogReadBits = 10;
+    int analogWriteBits = 8;
+    bool interruptsEnabled = true;
+    std::size_t pendingInterrupts = 0u;
+
+    void runIsr(int pin) {
+        PinIo& io = pinIo()[pin];
+        bool enabled = interruptsEnabled;
+        interruptsEnabled = false;
+        io.interruptCount += 1u;
+        io.isr();
+        interruptsEnabled = enabled;
+    }
+
+    void runPendingInterrupts() {
+        // Lower pin numbers first, like the fixed priorities of interrupt vectors
+        for (std::size_t pin = 0u; pendingInterrupts > 0u && interruptsEnabled && pin < pinIo().size(); ++pin) {
+            if (pinIo()[pin].interruptPending) {
+                pinIo()[pin].interruptPending = false;
+                pendingInterrupts -= 1u;
+                if (pinIo()[pin].isr != nullptr) {
+                    runIsr(static_cast<int>(pin));
+                }
+                pin = static_cast<std::size_t>(-1); // An ISR may have raised others
+            }
+        }
+    }
+
+    void raiseInterrupt(int pin) {
+        if (interruptsEnabled) {
+            runIsr(pin);
+            runPendingInterrupts();
+        } else if (!pinIo()[pin].interruptPending) {
+            pinIo()[pin].interruptPending = true;
+            pendingInterrupts += 1u;
+        }
+    }
+
+    // Update the level of a pin and raise its interrupt if the change matches.
+    void setLevel(int pin, bool level) {
+        bool previous = getBit(gpio().values, pin);
+        setBit(gpio().values, pin, level);
+        const PinIo& io = pinIo()[pin];
+        if (io.isr == nullptr || previous == level) {
+            return;
+        }
+        bool matches = io.interruptMode == CHANGE ||
+                       (io.interruptMode == RISING && level) ||
+                       ((io.interruptMode == FALLING || io.interruptMode == LOW) && !level);
+        if (matches) {
+            raiseInterrupt(pin);
+        }
+    }
+
+    // Time of the first level change of a waveform after the given time.
+    bool nextStimulusChange(const Stimulus& stimulus, unsigned long time, unsigned long& next) {
+        switch (stimulus.kind) {
+        case Stimulus::Kind::SquareWave: {
+            if (stimulus.period == 0u || stimulus.high == 0u) return false;
+            if (time < stimulus.phase) {
+                next = stimulus.phase;
+                return true;
+            }
+            if (stimulus.high >= stimulus.period) return false;
+            unsigned long start = time - (time - stimulus.phase) % stimulus.period;
+            next = time - start < stimulus.high ? start + stimulus.high : start + stimulus.period;
+            return true;
+        }
+        case Stimulus::Kind::Levels: {
+            auto change = std::upper_bound(stimulus.changes.begin(), stimulus.changes.end(), time,
+                [](unsigned long t, const GpioLevelChange& c) { return t < c.micros; });
+            if (change == stimulus.changes.end()) return false;
+            next = change->micros;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // (Re-)schedule the next stimulus edge of a pin with an interrupt attached.
+    void scheduleStimulusEdge(int pin) {
+        PinIo& io = pinIo()[pin];
+        unsigned long generation = ++io.edgeGeneration;
+        const Stimulus& stimulus = stimuli()[pin];
+        if (io.isr == nullptr || (stimulus.kind != Stimulus::Kind::SquareWave && stimulus.kind != Stimulus::Kind::Levels)) {
+            return;
+        }
+        setBit(gpio().values, pin, stimulus.valueAt(micros()) != 0);
+        unsigned long next = 0u;
+        if (nextStimulusChange(stimulus, micros(), next)) {
+            scheduleMockEvent(next, [pin, generation]() {
+                if (pinIo()[pin].edgeGeneration == generation) {
+                    setLevel(pin, stimuli()[pin].valueAt(micros()) != 0);
+                    scheduleStimulusEdge(pin);
+                }
+            });
+        }
+    }
+
+    // Ring buffer of GPIO trace events, capacity is a power of two.
+    std::vector<GpioEvent> traceEvents {};
+    std::size_t traceMask = 0u;
+    std::size_t traceNext = 0u; // Total number of recorded events
+    bool traceEnabled = false;
+    // Pin values when the trace was (re-)started
+    std::vector<uint64_t>& traceInitialValues() {
+        static std::vector<uint64_t> values = gpio().values;
+        return values;
+    }
+
+    inline void traceEvent(int pin, GpioEventType type, int value) {
+        if (traceEnabled) {
+            traceEvents[traceNext & traceMask] = GpioEvent { micros(), static_cast<uint16_t>(pin), type, static_cast<uint8_t>(value) };
+            traceNext += 1u;
+        }
+    }
+}
+
+void startGpioTrace(std::size_t capacity) {
+  std::size_t size = 1u;
+  while (size < capacity) {
+    size <<= 1u;
+  }
+  traceEvents.assign(size, GpioEvent {});
+  traceMask = size - 1u;
+  traceEnabled = true;
+  clearGpioTrace();
+}
+
+void stopGpioTrace() {
+  traceEnabled = false;
+}
+
+void clearGpioTrace() {
+  traceNext = 0u;
+  traceInitialValues() = gpio().values;
+}
+
+std::size_t getGpioTraceSize() {
+  return std::min(traceNext, traceEvents.size());
+}
+
+std::size_t getGpioTraceDroppedCount() {
+  return traceNext - getGpioTraceSize();
+}
+
+const GpioEvent& getGpioTraceEvent(std::size_t index) {
+  return traceEvents[(traceNext - getGpioTraceSize() + index) & traceMask];
+}
+
+std::vector<GpioEvent> getGpioEdges(int pin) {
+  std::vector<GpioEvent> edges {};
+  if (pin < 0 || static_cast<std::size_t>(pin) >= board->pinCount) {
+    return edges;
+  }
+  // The initial level is unknown if the oldest events were overwritten already
+  int level = getGpioTraceDroppedCount() == 0u ? (getBit(traceInitialValues(), pin) ? HIGH : LOW) : -1;
+  for (std::size_t i = 0u, size = getGpioTraceSize(); i < size; ++i) {
+    const GpioEvent& event = getGpioTraceEvent(i);
+    if (event.pin != pin || event.type == GpioEventType::PinMode) {
+      continue;
+    }
+    if (event.value != level) {
+      if (level != -1) {
+        edges.push_back(event);
+      }
+      level = event.value;
+    }
+  }
+  return edges;
+}
+
+std::vector<unsigned long> getGpioPulseWidths(int pin, int level) {
+  std::vector<unsigned long> widths {};
+  std::vector<GpioEvent> edges = getGpioEdges(pin);
+  for (std::size_t i = 0u; i + 1u < edges.size(); ++i) {
+    if (edges[i].value == level) {
+      widths.push_back(edges[i + 1u].micros - edges[i].micros);
+    }
+  }
+  return widths;
+}
+
+bool writeGpioTraceVcd(const char* path) {
+  std::FILE* file = std::fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  // VCD identifiers are made of printable characters '!' to '~'
+  std::map<int, std::string> ids {};
+  std::size_t size = getGpioTraceSize();
+  for (std::size_t i = 0u; i < size; ++i) {
+    const GpioEvent& event = getGpioTraceEvent(i);
+    if (event.type != GpioEventType::PinMode && ids.find(event.pin) == ids.end()) {
+      std::string id {};
+      for (std::size_t n = ids.size(); ; n = n / 94u - 1u) {
+        id += static_cast<char>('!' + n % 94u);
+        if (n < 94u) break;
+      }
+      ids.emplace(event.pin, id);
+    }
+  }
+
+  std::fprintf(file, "$timescale 1us $end\n$scope module gpio $end\n");
+  for (auto& [pin, id] : ids) {
+    std::fprintf(file, "$var wire 1 %s pin%d $end\n", id.c_str(), pin);
+  }
+  std::fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+
+  std::map<int, int> levels {};
+  if (getGpioTraceDroppedCount() == 0u) {
+    std::fprintf(file, "$dumpvars\n");
+    for (auto& [pin, id] : ids) {
+      levels[pin] = getBit(traceInitialValues(), pin) ? HIGH : LOW;
+      std::fprintf(file, "%c%s\n", levels[pin] ? '1' : '0', id.c_str());
+    }
+    std::fprintf(file, "$end\n");
+  }
+  unsigned long time = 0u;
+  bool first = true;
+  for (std::size_t i = 0u; i < size; ++i) {
+    const GpioEvent& event = getGpioTraceEvent(i);
+    if (event.type == GpioEventType::PinMode) {
+      continue;
+    }
+    auto level = levels.find(event.pin);
+    if (level != levels.end() && level->second == event.value) {
+      continue;
+    }
+    levels[event.pin] = event.value;
+    if (first || event.micros != time) {
+      std::fprintf(file, "#%lu\n", event.micros);
+      time = event.micros;
+      first = false;
+    }
+    std::fprintf(file, "%c%s\n", event.value ? '1' : '0', ids[event.pin].c_str());
+  }
+  return std::fclose(file) == 0;
+}
+
+void setBoard(const BoardProfile& profile) {
+  board = &profile;
+  resetGpioMocks();
+}
+
+const BoardProfile& getBoard() {
+  return *board;
+}
+
+long boardInt(long value) {
+  return signedToWidth(value, board->intBits);
+}
+
+unsigned long boardUnsignedInt(unsigned long value) {
+  return unsignedToWidth(value, board->intBits);
+}
+
+long boardLong(long value) {
+  return signedToWidth(value, board->longBits);
+}
+
+unsigned long boardUnsignedLong(unsigned long value) {
+  return unsignedToWidth(value, board->longBits);
+}
+
+double boardDouble(double value) {
+  return board->doubleBits <= 32u ? static_cast<double>(static_cast<float>(value)) : value;
 }
 
 void resetGpioMocks() {
-  std::fill_n(pinModes, GPIO_MOCK_MAX_PINS, -1);
-  std::fill_n(pinValues, GPIO_MOCK_MAX_PINS, 0);
+  gpio() = emptyGpioState(board->pinCount);
   digitalWriteCalls = 0u;
+  invalidGpioCalls = 0u;
   lastDigitalWritePin = NOT_A_PIN;
   lastDigitalWriteValue = 0;
   lastPinModePin = NOT_A_PIN;
   lastPinModeMode = 0;
+  stimuli().assign(board->pinCount, Stimulus {});
+  pinIo().assign(board->pinCount, PinIo {});
+  analogReadBits = 10;
+  analogWriteBits = 8;
+  interruptsEnabled = true;
+  pendingInterrupts = 0u;
+  clearMockEvents();
+  clearGpioTrace();
 }
 
 void setDigitalReadValue(int pin, int value) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  if (!isPin(pin)) {
+    return;
+  }
+  stimuli()[pin] = Stimulus {};
+  scheduleStimulusEdge(pin);
+  setLevel(pin, value != 0);
+}
+
+void setDigitalReadSquareWave(int pin, unsigned long periodMicros, unsigned long highMicros, unsigned long phaseMicros) {
+  if (!isPin(pin)) {
     return;
   }
-  pinValues[pin] = value;
+  stimuli()[pin] = Stimulus {};
+  stimuli()[pin].kind = Stimulus::Kind::SquareWave;
+  stimuli()[pin].period = periodMicros;
+  stimuli()[pin].high = highMicros;
+  stimuli()[pin].phase = phaseMicros;
+  scheduleStimulusEdge(pin);
+}
+
+void setDigitalReadLevels(int pin, std::vector<GpioLevelChange> changes, int initialValue) {
+  if (!isPin(pin)) {
+    return;
+  }
+  stimuli()[pin] = Stimulus {};
+  stimuli()[pin].kind = Stimulus::Kind::Levels;
+  stimuli()[pin].changes = std::move(changes);
+  stimuli()[pin].initialValue = initialValue;
+  scheduleStimulusEdge(pin);
+}
+
+void setDigitalReadCallback(int pin, std::function<int(unsigned long micros)> callback) {
+  if (!isPin(pin)) {
+    return;
+  }
+  stimuli()[pin] = Stimulus {};
+  stimuli()[pin].kind = Stimulus::Kind::Callback;
+  stimuli()[pin].callback = std::move(callback);
+  scheduleStimulusEdge(pin);
+}
+
+void clearDigitalReadStimulus(int pin) {
+  if (!isPin(pin)) {
+    return;
+  }
+  stimuli()[pin] = Stimulus {};
+  scheduleStimulusEdge(pin);
 }
 
 int getPinMode(int pin) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  if (!isPin(pin) || !getBit(gpio().configured, pin)) {
     return -1;
   }
-  return pinModes[pin];
+  return getBit(gpio().modes[0], pin) | getBit(gpio().modes[1], pin) << 1 | getBit(gpio().modes[2], pin) << 2;
 }
 
 int getLastPinModePin() {
@@ -48,10 +715,10 @@ int getLastPinModeMode() {
 }
 
 int getDigitalWriteValue(int pin) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  if (!isPin(pin)) {
     return 0;
   }
-  return pinValues[pin];
+  return getBit(gpio().values, pin) ? HIGH : LOW;
 }
 
 int getLastDigitalWritePin() {
@@ -66,28 +733,192 @@ std::size_t getDigitalWriteCallCount() {
   return digitalWriteCalls;
 }
 
+std::size_t getInvalidGpioCallCount() {
+  return invalidGpioCalls;
+}
+
+GpioSnapshot takeGpioSnapshot() {
+  return gpio();
+}
+
 void pinMode(int pin, int mode) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  countMockCall(MockCall::PinMode);
+  if (!isValidPin(pin)) {
+    return;
+  }
+  if (mode < 0 || mode > 7 || !((board->pinModes >> mode) & 1u)) {
+    invalidGpioCalls += 1u;
     return;
   }
-  pinModes[pin] = mode;
+  setBit(gpio().configured, pin, true);
+  setBit(gpio().modes[0], pin, mode & 1);
+  setBit(gpio().modes[1], pin, mode & 2);
+  setBit(gpio().modes[2], pin, mode & 4);
   lastPinModePin = pin;
   lastPinModeMode = mode;
+  traceEvent(pin, GpioEventType::PinMode, mode);
 }
 
 int digitalRead(int pin) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  countMockCall(MockCall::DigitalRead);
+  if (!isValidPin(pin)) {
     return 0;
   }
-  return pinValues[pin];
+  if (stimuli()[pin].kind != Stimulus::Kind::None) {
+    setBit(gpio().values, pin, stimuli()[pin].valueAt(micros()) != 0);
+  }
+  int value = getBit(gpio().values, pin) ? HIGH : LOW;
+  traceEvent(pin, GpioEventType::DigitalRead, value);
+  return value;
 }
 
 void digitalWrite(int pin, int value) {
-  if (pin < 0 || static_cast<std::size_t>(pin) >= GPIO_MOCK_MAX_PINS) {
+  countMockCall(MockCall::DigitalWrite);
+  if (!isValidPin(pin)) {
     return;
   }
-  pinValues[pin] = value;
+  setLevel(pin, value != 0);
   lastDigitalWritePin = pin;
   lastDigitalWriteValue = value;
   digitalWriteCalls += 1u;
+  traceEvent(pin, GpioEventType::DigitalWrite, value != 0 ? HIGH : LOW);
+  for (std::size_t i = 0u; i < digitalWriteObservers.size(); ++i) {
+    if (digitalWriteObservers[i].pin == pin) {
+      digitalWriteObservers[i].observer(value != 0 ? HIGH : LOW);
+    }
+  }
+}
+
+std::size_t addDigitalWriteObserver(int pin, std::function<void(int value)> observer) {
+  std::size_t id = nextDigitalWriteObserverId++;
+  digitalWriteObservers.push_back(DigitalWriteObserver { id, pin, std::move(observer) });
+  return id;
+}
+
+void removeDigitalWriteObserver(std::size_t id) {
+  digitalWriteObservers.erase(std::remove_if(digitalWriteObservers.begin(), digitalWriteObservers.end(),
+      [id](const DigitalWriteObserver& entry) { return entry.id == id; }), digitalWriteObservers.end());
+}
+
+void interrupts() {
+  interruptsEnabled = true;
+  runPendingInterrupts();
+}
+
+void noInterrupts() {
+  interruptsEnabled = false;
+}
+
+bool getInterruptsEnabled() {
+  return interruptsEnabled;
+}
+
+void attachInterrupt(int interrupt, void (*isr)(), int mode) {
+  if (!isValidPin(interrupt)) {
+    return;
+  }
+  pinIo()[interrupt].isr = isr;
+  pinIo()[interrupt].interruptMode = mode;
+  scheduleStimulusEdge(interrupt);
+}
+
+void detachInterrupt(int interrupt) {
+  if (!isValidPin(interrupt)) {
+    return;
+  }
+  PinIo& io = pinIo()[interrupt];
+  io.isr = nullptr;
+  if (io.interruptPending) {
+    io.interruptPending = false;
+    pendingInterrupts -= 1u;
+  }
+  scheduleStimulusEdge(interrupt);
+}
+
+std::size_t getInterruptCount(int pin) {
+  if (!isPin(pin)) {
+    return 0u;
+  }
+  return pinIo()[pin].interruptCount;
+}
+
+int analogRead(int pin) {
+  countMockCall(MockCall::AnalogRead);
+  if (!isValidPin(pin)) {
+    return 0;
+  }
+  const PinIo& io = pinIo()[pin];
+  int value = io.analogReadCallback ? io.analogReadCallback(micros()) : io.analogReadValue;
+  int max = (1 << analogReadBits) - 1;
+  return value < 0 ? 0 : (value > max ? max : value);
+}
+
+void analogWrite(int pin, int value) {
+  countMockCall(MockCall::AnalogWrite);
+  if (!isValidPin(pin)) {
+    return;
+  }
+  int max = (1 << analogWriteBits) - 1;
+  pinIo()[pin].analogWriteValue = value < 0 ? 0 : (value > max ? max : value);
+}
+
+void analogReadResolution(int bits) {
+  analogReadBits = bits < 1 ? 1 : (bits > 16 ? 16 : bits);
+}
+
+void analogWriteResolution(int bits) {
+  analogWriteBits = bits < 1 ? 1 : (bits > 16 ? 16 : bits);
+}
+
+void setAnalogReadValue(int pin, int value) {
+  if (!isPin(pin)) {
+    return;
+  }
+  pinIo()[pin].analogReadCallback = nullptr;
+  pinIo()[pin].analogReadValue = value;
+}
+
+void setAnalogReadCallback(int pin, std::function<int(unsigned long micros)> callback) {
+  if (!isPin(pin)) {
+    return;
+  }
+  pinIo()[pin].analogReadCallback = std::move(callback);
+}
+
+int getAnalogWriteValue(int pin) {
+  if (!isPin(pin)) {
+    return -1;
+  }
+  return pinIo()[pin].analogWriteValue;
+}
+
+void tone(int pin, unsigned int frequency, unsigned long durationMs) {
+  if (!isValidPin(pin)) {
+    return;
+  }
+  PinIo& io = pinIo()[pin];
+  io.toneFrequency = frequency;
+  unsigned long generation = ++io.toneGeneration;
+  if (durationMs > 0u) {
+    scheduleMockEvent(micros() + durationMs * 1000u, [pin, generation]() {
+      if (pinIo()[pin].toneGeneration == generation) {
+        pinIo()[pin].toneFrequency = 0u;
+      }
+    });
+  }
+}
+
+void noTone(int pin) {
+  if (!isValidPin(pin)) {
+    return;
+  }
+  pinIo()[pin].toneFrequency = 0u;
+  pinIo()[pin].toneGeneration += 1u;
+}
+
+unsigned int getToneFrequency(int pin) {
+  if (!isPin(pin)) {
+    return 0u;
+  }
+  return pinIo()[pin].toneFrequency;
 }
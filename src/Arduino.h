@@ -8,7 +8,99 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cctype>
+#include <functional>
+#include <vector>
 
+#if defined(YATEST_PROGMEM_SECTION) && defined(__ELF__)
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+// PROGMEM support with a separate section (opt-in with YATEST_PROGMEM_SECTION):
+// PROGMEM data is placed into the yatest_progmem section and PSTR()/F()
+// strings into yatest_progmem_str_* sections, and pgm_read_*()/*_P() functions
+// throw std::logic_error for pointers outside of them (i.e. RAM data read as
+// if it was in flash).
+//
+// A string of PSTR() in an inline function or a template is in a COMDAT
+// group, and GCC rejects such objects in a section shared with other objects
+// ("section type conflict"), so each PSTR() gets its own section. Those have
+// no common bounds, each string registers its range on first use instead.
+#define PROGMEM __attribute__((section("yatest_progmem")))
+#define PGM_P const char*
+#define YATEST_PROGMEM_STRINGIZE_(x) #x
+#define YATEST_PROGMEM_STRINGIZE(x) YATEST_PROGMEM_STRINGIZE_(x)
+#define YATEST_PROGMEM_STR(counter) __attribute__((section("yatest_progmem_str_" YATEST_PROGMEM_STRINGIZE(counter))))
+#define PSTR(s) (__extension__({ \
+    static const char __pstr[] YATEST_PROGMEM_STR(__COUNTER__) = (s); \
+    static const char* const __pstr_registered = yatest_progmem_register(__pstr, sizeof(__pstr)); \
+    __pstr_registered; }))
+#define FPSTR(s) reinterpret_cast<const __FlashStringHelper*>(yatest_progmem_ptr(s))
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
+
+extern "C" const char __start_yatest_progmem[] __attribute__((weak));
+extern "C" const char __stop_yatest_progmem[] __attribute__((weak));
+
+// Ranges of the PSTR() strings used so far, by begin address.
+struct YatestProgmemStrings {
+    std::mutex mutex;
+    std::map<std::uintptr_t, std::uintptr_t> ranges;
+};
+
+inline YatestProgmemStrings& yatest_progmem_strings() {
+    static YatestProgmemStrings strings;
+    return strings;
+}
+
+inline const char* yatest_progmem_register(const char* str, std::size_t size) {
+    YatestProgmemStrings& strings = yatest_progmem_strings();
+    std::lock_guard<std::mutex> lock(strings.mutex);
+    auto address = reinterpret_cast<std::uintptr_t>(str);
+    strings.ranges[address] = address + size;
+    return str;
+}
+
+inline bool yatest_progmem_contains(std::uintptr_t address) {
+    if (address >= reinterpret_cast<std::uintptr_t>(__start_yatest_progmem) &&
+        address < reinterpret_cast<std::uintptr_t>(__stop_yatest_progmem)) {
+        return true;
+    }
+    YatestProgmemStrings& strings = yatest_progmem_strings();
+    std::lock_guard<std::mutex> lock(strings.mutex);
+    auto next = strings.ranges.upper_bound(address);
+    return next != strings.ranges.begin() && address < std::prev(next)->second;
+}
+
+template<typename T>
+inline T* yatest_progmem_ptr(T* addr) {
+    if (!yatest_progmem_contains(reinterpret_cast<std::uintptr_t>(addr))) {
+        throw std::logic_error("PROGMEM access to a pointer which is not in PROGMEM");
+    }
+    return addr;
+}
+
+#define pgm_read_byte(addr) (*(const unsigned char *)yatest_progmem_ptr(addr))
+#define pgm_read_word(addr) (*(const unsigned short *)yatest_progmem_ptr(addr))
+#define pgm_read_dword(addr) (*(const unsigned long *)yatest_progmem_ptr(addr))
+#define pgm_read_float(addr) (*(const float *)yatest_progmem_ptr(addr))
+#define pgm_read_ptr(addr) (*(const void **)yatest_progmem_ptr(addr))
+
+#define strlen_P(s) strlen(yatest_progmem_ptr(s))
+#define strcpy_P(dest, src) strcpy((dest), yatest_progmem_ptr(src))
+#define strncpy_P(dest, src, n) strncpy((dest), yatest_progmem_ptr(src), (n))
+#define strcmp_P(s1, s2) strcmp((s1), yatest_progmem_ptr(s2))
+#define strncmp_P(s1, s2, n) strncmp((s1), yatest_progmem_ptr(s2), (n))
+#define strchr_P(s, c) strchr(yatest_progmem_ptr(s), (c))
+#define strstr_P(s1, s2) strstr((s1), yatest_progmem_ptr(s2))
+#define memcpy_P(dest, src, n) memcpy((dest), yatest_progmem_ptr(src), (n))
+#define memcmp_P(s1, s2, n) memcmp((s1), yatest_progmem_ptr(s2), (n))
+#define memchr_P(s, c, n) memchr(yatest_progmem_ptr(s), (c), (n))
+#define sprintf_P(s, format, ...) sprintf((s), yatest_progmem_ptr(format), ##__VA_ARGS__)
+#define snprintf_P(s, n, format, ...) snprintf((s), (n), yatest_progmem_ptr(format), ##__VA_ARGS__)
+#define vsnprintf_P(s, n, format, args) vsnprintf((s), (n), yatest_progmem_ptr(format), (args))
+#else
 // PROGMEM support (no-op for native compilation)
 #define PROGMEM
 #define PGM_P const char*
@@ -36,6 +128,12 @@
 #define snprintf_P snprintf
 #define vsnprintf_P vsnprintf
 
+template<typename T>
+inline T* yatest_progmem_ptr(T* addr) {
+    return addr;
+}
+#endif
+
 // Serial configuration constants
 #define SERIAL_5N1 0x00
 #define SERIAL_6N1 0x02
@@ -46,6 +144,8 @@
 #define INPUT 0x0
 #define OUTPUT 0x1
 #define INPUT_PULLUP 0x2
+#define INPUT_PULLDOWN 0x3
+#define OUTPUT_OPENDRAIN 0x4
 
 // Digital levels
 #define LOW 0x0
@@ -76,6 +176,9 @@
 // Don't redefine toLowerCase/toUpperCase - they conflict with C++ String methods
 
 // Bit manipulation
+#define LSBFIRST 0
+#define MSBFIRST 1
+
 #define bit(b) (1UL << (b))
 #define bitRead(value, bit) (((value) >> (bit)) & 0x01)
 #define bitSet(value, bit) ((value) |= (1UL << (bit)))
@@ -110,13 +213,53 @@ inline unsigned long micros() {
     return _test_micros;
 }
 
-inline void delay(unsigned long ms) {
-    _test_millis += ms;
-}
+// Call site of the code under test in a mock: the return address of a mock
+// function which is not inlined, so the signatures stay those of the Arduino
+// API. It is resolved to file and line only for the wait profile.
+#if defined(__GNUC__) || defined(__clang__)
+#define YATEST_MOCK_NOINLINE __attribute__((noinline))
+#define YATEST_MOCK_CALLER MockCallSite(__builtin_return_address(0))
+#else
+#define YATEST_MOCK_NOINLINE
+#define YATEST_MOCK_CALLER MockCallSite()
+#endif
+
+struct MockCallSite {
+    const void* address;
+
+    explicit MockCallSite(const void* address = nullptr) : address(address) {}
+};
 
-inline void delayMicroseconds(unsigned int us) {
-    _test_micros += us;
-}
+// Virtual clock: delays advance millis() and micros() and run all events
+// scheduled on the way (stimulus edges raising interrupts, tone() ends and
+// custom events) at their exact time, in order.
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void advanceMockTime(unsigned long microsDelta);
+// Let simulated time pass while the code under test waits (delays, Stream
+// timeouts), accounted to the call site in the wait profile.
+void waitMockTime(unsigned long micros, const char* kind, MockCallSite site);
+
+// Wait profile: simulated time spent waiting per call site and kind of wait.
+// The file is empty and the line 0 if the address cannot be resolved (no
+// debug information or addr2line).
+struct MockWaitSite {
+    const char* kind;
+    const void* address;
+    const char* file;
+    int line;
+    unsigned long long micros;
+    unsigned long long calls;
+};
+
+// Call sites sorted by waiting time, largest first.
+std::vector<MockWaitSite> getMockWaitProfile();
+void resetMockWaitProfile();
+// Run the callback once the virtual clock reaches atMicros (events at the same
+// time run in the order they were scheduled).
+void scheduleMockEvent(unsigned long atMicros, std::function<void()> callback);
+std::size_t getPendingMockEventCount();
+void clearMockEvents();
 
 inline void yield() {
     // No-op for tests
@@ -228,9 +371,12 @@ inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-// Interrupt functions (no-op for testing)
-inline void interrupts() {}
-inline void noInterrupts() {}
+// Interrupts: noInterrupts() defers ISRs raised until interrupts() (at most
+// one pending per pin, like the hardware flags). ISRs run with interrupts
+// disabled.
+void interrupts();
+void noInterrupts();
+bool getInterruptsEnabled();
 
 // GPIO functions and constants
 #define NOT_A_PIN -1
@@ -239,8 +385,103 @@ void pinMode(int pin, int mode);
 int digitalRead(int pin);
 void digitalWrite(int pin, int value);
 
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) (p)
+
+// Interrupts are raised by level changes of a pin: setDigitalReadValue(),
+// digitalWrite() and square wave or level stimuli (edges are scheduled on the
+// virtual clock). LOW triggers when the pin becomes LOW. Callback stimuli
+// cannot raise interrupts.
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+void detachInterrupt(int interrupt);
+std::size_t getInterruptCount(int pin); // ISR invocations since the reset
+
+// Analog I/O and tone: analogRead() returns the value set for the pin (clamped
+// to the read resolution, 10 bits by default), analogWrite() and tone() record
+// the last duty cycle and frequency.
+int analogRead(int pin);
+void analogWrite(int pin, int value);
+void analogReadResolution(int bits);
+void analogWriteResolution(int bits);
+inline void analogReference(uint8_t) {}
+void tone(int pin, unsigned int frequency, unsigned long durationMs = 0);
+void noTone(int pin);
+void setAnalogReadValue(int pin, int value);
+void setAnalogReadCallback(int pin, std::function<int(unsigned long micros)> callback);
+int getAnalogWriteValue(int pin); // -1 if not written since the reset
+unsigned int getToneFrequency(int pin); // 0 if no tone is playing
+
+// Observe digitalWrite() calls of a pin, e.g. to model the chip select of a
+// simulated bus device. Observers are kept by resetGpioMocks(), remove them
+// with the returned id.
+std::size_t addDigitalWriteObserver(int pin, std::function<void(int value)> observer);
+void removeDigitalWriteObserver(std::size_t id);
+
+// Mock call counters, e.g. to estimate the time the code would take on the
+// target board (see yatest/CostEstimate.h). Print writes and Stream reads are
+// counted per byte, String operations per constructed or modified string.
+enum struct MockCall : uint8_t {
+    PinMode,
+    DigitalWrite,
+    DigitalRead,
+    AnalogRead,
+    AnalogWrite,
+    PrintWrite,
+    StreamRead,
+    StringOp,
+    Delay
+};
+
+constexpr std::size_t MOCK_CALL_KINDS = 9;
+
+extern unsigned long long _mock_call_counts[MOCK_CALL_KINDS];
+extern unsigned long long _mock_delay_micros; // Time waited in delay()/delayMicroseconds()
+
+inline void countMockCall(MockCall call, unsigned long long count = 1) {
+    _mock_call_counts[static_cast<std::size_t>(call)] += count;
+}
+
+const char* getMockCallName(MockCall call);
+void resetMockCallCounts();
+
+// Board profiles: the pin count and valid pin modes of the GPIO mocks and the
+// widths of int/long/double used by the formatting mocks (Print, String).
+struct BoardProfile {
+    const char* name;
+    std::size_t pinCount;
+    uint32_t pinModes; // Valid pin modes as bit mask, e.g. bit(INPUT) | bit(OUTPUT)
+    uint8_t intBits;
+    uint8_t longBits;
+    uint8_t doubleBits;
+    uint32_t clockHz;   // CPU clock, 0 if unknown (no cost estimates)
+    uint16_t callCycles[MOCK_CALL_KINDS]; // Approximate CPU cycles per MockCall
+};
+
+extern const BoardProfile BOARD_GENERIC; // 64 pins, all modes, host type widths (default)
+extern const BoardProfile BOARD_UNO;
+extern const BoardProfile BOARD_MEGA;
+extern const BoardProfile BOARD_ESP32;
+extern const BoardProfile BOARD_RP2040;
+
+// Select the board to simulate, which also resets the GPIO mocks.
+void setBoard(const BoardProfile& board);
+const BoardProfile& getBoard();
+
+// Convert values to the width of the respective type on the current board
+// (e.g. 16 bit int and 32 bit double on AVR boards).
+long boardInt(long value);
+unsigned long boardUnsignedInt(unsigned long value);
+long boardLong(long value);
+unsigned long boardUnsignedLong(unsigned long value);
+double boardDouble(double value);
+
 // Expose a small mock GPIO backend for tests.
-constexpr std::size_t GPIO_MOCK_MAX_PINS = 64;
+constexpr std::size_t GPIO_MOCK_MAX_PINS = 64; // Pin count of BOARD_GENERIC
+// Resets pins, stimuli, interrupts, analog values, tones and the trace, and
+// clears all scheduled events.
 void resetGpioMocks();
 void setDigitalReadValue(int pin, int value);
 int getPinMode(int pin);
@@ -250,6 +491,74 @@ int getDigitalWriteValue(int pin);
 int getLastDigitalWritePin();
 int getLastDigitalWriteValue();
 std::size_t getDigitalWriteCallCount();
+// Number of GPIO calls with a pin or mode which is not valid for the board
+// (these calls are ignored). Only calls of the Arduino API are counted, not
+// of the test helpers like getPinMode().
+std::size_t getInvalidGpioCallCount();
+
+// Pin state stored densely as bit sets (one bit per pin), so taking and
+// comparing snapshots is cheap.
+struct GpioSnapshot {
+    std::vector<uint64_t> values;
+    std::vector<uint64_t> configured;   // Pins with a mode set by pinMode()
+    std::vector<uint64_t> modes[3];     // Bit planes of the pin modes
+
+    bool operator==(const GpioSnapshot& other) const {
+        return values == other.values && configured == other.configured &&
+               modes[0] == other.modes[0] && modes[1] == other.modes[1] && modes[2] == other.modes[2];
+    }
+    bool operator!=(const GpioSnapshot& other) const { return !(*this == other); }
+};
+
+GpioSnapshot takeGpioSnapshot();
+
+// Digital input stimulus: instead of the static value set by
+// setDigitalReadValue(), digitalRead() evaluates a waveform attached to the pin
+// at the current micros(). Setting a static value detaches the waveform.
+struct GpioLevelChange {
+    unsigned long micros;
+    int value;
+};
+
+// Square wave with the given period, HIGH for highMicros at the start of each
+// period. The first period starts at phaseMicros (LOW before).
+void setDigitalReadSquareWave(int pin, unsigned long periodMicros, unsigned long highMicros, unsigned long phaseMicros = 0);
+// Recorded level changes sorted by time (e.g. from getGpioEdges() of a trace),
+// with initialValue before the first one. Looked up in O(log n).
+void setDigitalReadLevels(int pin, std::vector<GpioLevelChange> changes, int initialValue = LOW);
+// Callback returning the level for a given time.
+void setDigitalReadCallback(int pin, std::function<int(unsigned long micros)> callback);
+void clearDigitalReadStimulus(int pin);
+
+// GPIO trace: while enabled, every pinMode/digitalWrite/digitalRead call is
+// recorded as a compact event timestamped with micros() into a preallocated
+// ring buffer (the oldest events are overwritten once it is full).
+enum struct GpioEventType : uint8_t {
+    PinMode,
+    DigitalWrite,
+    DigitalRead
+};
+
+struct GpioEvent {
+    unsigned long micros;
+    uint16_t pin;
+    GpioEventType type;
+    uint8_t value; // Mode for PinMode, level otherwise
+};
+
+void startGpioTrace(std::size_t capacity = 1u << 20);
+void stopGpioTrace();
+void clearGpioTrace();
+std::size_t getGpioTraceSize();
+std::size_t getGpioTraceDroppedCount();
+// Recorded events, oldest first (index < getGpioTraceSize()).
+const GpioEvent& getGpioTraceEvent(std::size_t index);
+// Level changes of a pin (writes or reads with a different level than before).
+std::vector<GpioEvent> getGpioEdges(int pin);
+// Durations (in micros) of completed pulses with the given level on a pin.
+std::vector<unsigned long> getGpioPulseWidths(int pin, int level);
+// Export the levels of all traced pins as Value Change Dump (e.g. for GTKWave).
+bool writeGpioTraceVcd(const char* path);
 
 
 // Serial/RingBuffer mocks
@@ -323,12 +632,20 @@ public:
     SerialMock(RingBuffer& rx, RingBuffer& tx) : rxBuffer(rx), txBuffer(tx) {}
     int available() { return rxBuffer.available(); }
     size_t availableForWrite() { return txBuffer.availableForWrite(); }
-    size_t readBytes(uint8_t* buffer, size_t length) { return rxBuffer.readBytes(buffer, length); }
+    size_t readBytes(uint8_t* buffer, size_t length) {
+        size_t count = rxBuffer.readBytes(buffer, length);
+        countMockCall(MockCall::StreamRead, count);
+        return count;
+    }
     size_t write(const uint8_t* buffer, size_t length) { return txBuffer.write(buffer, length); }
     void begin(unsigned long baud, int config) { (void)baud; (void)config; }
     void setTimeout(unsigned long timeout) { (void)timeout; }
     void flush() { rxBuffer.flush(); }
-    int read() { return rxBuffer.read(); }
+    int read() {
+        int c = rxBuffer.read();
+        if (c >= 0) countMockCall(MockCall::StreamRead);
+        return c;
+    }
 };
 
 // Provide default Serial instance expected by Arduino sketches.
@@ -0,0 +1,251 @@
+#include "BusMock.h"
+#include "Wire.h"
+#include "SPI.h"
+
+#include <algorithm>
+#include <cstring>
+
+TwoWire Wire {};
+SPIClass SPI {};
+
+namespace {
+    struct BusLog {
+        std::vector<BusTransaction> transactions {};
+        std::vector<uint8_t> bytes {};
+        bool enabled = false;
+    };
+
+    // The log is constructed on first use (not by a global initializer), so
+    // buses used from constructors of globals in other sources are logged.
+    BusLog& busLog() {
+        static BusLog log {};
+        return log;
+    }
+
+    void logBusTransaction(BusTransactionType type, uint16_t address, uint8_t status,
+                           const uint8_t* sent, std::size_t sentLength,
+                           const uint8_t* received, std::size_t receivedLength) {
+        BusLog& log = busLog();
+        if (!log.enabled) {
+            return;
+        }
+        std::size_t offset = log.bytes.size();
+        log.bytes.insert(log.bytes.end(), sent, sent + sentLength);
+        log.bytes.insert(log.bytes.end(), received, received + receivedLength);
+        log.transactions.push_back(BusTransaction { micros(), type, address, status, sentLength, receivedLength, offset });
+    }
+}
+
+void startBusLog() {
+  busLog().enabled = true;
+}
+
+void stopBusLog() {
+  busLog().enabled = false;
+}
+
+void clearBusLog() {
+  busLog().transactions.clear();
+  busLog().bytes.clear();
+}
+
+std::size_t getBusLogSize() {
+  return busLog().transactions.size();
+}
+
+const BusTransaction& getBusTransaction(std::size_t index) {
+  return busLog().transactions.at(index);
+}
+
+const uint8_t* getBusTransactionSent(const BusTransaction& transaction) {
+  return busLog().bytes.data() + transaction.offset;
+}
+
+const uint8_t* getBusTransactionReceived(const BusTransaction& transaction) {
+  return busLog().bytes.data() + transaction.offset + transaction.sentLength;
+}
+
+void RegisterMap::readRegisters(uint8_t reg, uint8_t* buffer, std::size_t length) {
+  if (onRead) {
+    for (std::size_t i = 0; i < length; ++i, ++reg) {
+      onRead(reg);
+      buffer[i] = registers[reg];
+    }
+    return;
+  }
+  while (length > 0) {
+    std::size_t chunk = std::min<std::size_t>(length, sizeof(registers) - reg);
+    std::memcpy(buffer, registers + reg, chunk);
+    buffer += chunk;
+    length -= chunk;
+    reg = static_cast<uint8_t>(reg + chunk);
+  }
+}
+
+void RegisterMap::writeRegisters(uint8_t reg, const uint8_t* buffer, std::size_t length) {
+  if (onWrite) {
+    for (std::size_t i = 0; i < length; ++i, ++reg) {
+      registers[reg] = buffer[i];
+      onWrite(reg, buffer[i]);
+    }
+    return;
+  }
+  while (length > 0) {
+    std::size_t chunk = std::min<std::size_t>(length, sizeof(registers) - reg);
+    std::memcpy(registers + reg, buffer, chunk);
+    buffer += chunk;
+    length -= chunk;
+    reg = static_cast<uint8_t>(reg + chunk);
+  }
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _txAddress = address;
+  _transmitting = true;
+  _txBuffer.clear();
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  (void)sendStop;
+  _transmitting = false;
+  uint8_t status = 0;
+  I2cDevice* device = _devices[_txAddress & 0x7f];
+  if (device == nullptr) {
+    status = 2;
+  } else if (!device->write(_txBuffer.data(), _txBuffer.size())) {
+    status = 3;
+  }
+  logBusTransaction(BusTransactionType::I2cWrite, _txAddress, status, _txBuffer.data(), _txBuffer.size(), nullptr, 0);
+  return status;
+}
+
+std::size_t TwoWire::requestFrom(int address, int quantity, int sendStop) {
+  (void)sendStop;
+  std::size_t length = quantity < 0 ? 0 : std::min(static_cast<std::size_t>(quantity), _bufferSize);
+  _rxBuffer.resize(length);
+  _rxIndex = 0;
+  I2cDevice* device = _devices[address & 0x7f];
+  std::size_t received = device != nullptr ? std::min(device->read(_rxBuffer.data(), length), length) : 0;
+  _rxBuffer.resize(received);
+  logBusTransaction(BusTransactionType::I2cRead, static_cast<uint16_t>(address & 0x7f), device != nullptr ? 0 : 2,
+                    nullptr, 0, _rxBuffer.data(), received);
+  return received;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (!_transmitting || _txBuffer.size() >= _bufferSize) {
+    return 0;
+  }
+  _txBuffer.push_back(data);
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length) {
+  if (!_transmitting) {
+    return 0;
+  }
+  length = std::min(length, _bufferSize - std::min(_bufferSize, _txBuffer.size()));
+  _txBuffer.insert(_txBuffer.end(), data, data + length);
+  return length;
+}
+
+size_t TwoWire::readBytes(uint8_t* buffer, size_t length) {
+  length = std::min(length, _rxBuffer.size() - _rxIndex);
+  std::memcpy(buffer, _rxBuffer.data() + _rxIndex, length);
+  _rxIndex += length;
+  return length;
+}
+
+void TwoWire::detachAllDevices() {
+  std::fill(std::begin(_devices), std::end(_devices), nullptr);
+}
+
+SpiDevice* SPIClass::selectedDevice(int& csPin) const {
+  for (const auto& attachment : _devices) {
+    if (attachment->selected) {
+      csPin = attachment->csPin;
+      return attachment->device;
+    }
+  }
+  csPin = NOT_A_PIN;
+  return nullptr;
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  uint8_t result = data;
+  transfer(&result, 1);
+  return result;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data) {
+  uint8_t buffer[2];
+  bool msbFirst = _settings.bitOrder == MSBFIRST;
+  buffer[msbFirst ? 0 : 1] = static_cast<uint8_t>(data >> 8);
+  buffer[msbFirst ? 1 : 0] = static_cast<uint8_t>(data);
+  transfer(buffer, 2);
+  return msbFirst ? static_cast<uint16_t>(buffer[0] << 8 | buffer[1]) : static_cast<uint16_t>(buffer[1] << 8 | buffer[0]);
+}
+
+void SPIClass::transfer(void* buffer, size_t count) {
+  uint8_t* bytes = static_cast<uint8_t*>(buffer);
+  uint8_t small[64];
+  std::vector<uint8_t> large {};
+  uint8_t* out = small;
+  if (count > sizeof(small)) {
+    large.assign(bytes, bytes + count);
+    out = large.data();
+  } else {
+    std::memcpy(small, bytes, count);
+  }
+  transferBytes(out, bytes, static_cast<uint32_t>(count));
+}
+
+void SPIClass::transferBytes(const uint8_t* out, uint8_t* in, uint32_t count) {
+  int csPin = NOT_A_PIN;
+  SpiDevice* device = selectedDevice(csPin);
+  if (device != nullptr) {
+    device->transfer(out, in, count);
+  } else {
+    std::memset(in, 0xff, count);
+  }
+  logBusTransaction(BusTransactionType::SpiTransfer, static_cast<uint16_t>(csPin), 0, out, count, in, count);
+}
+
+void SPIClass::writeBytes(const uint8_t* data, uint32_t count) {
+  std::vector<uint8_t> ignored(count);
+  transferBytes(data, ignored.data(), count);
+}
+
+void SPIClass::attachDevice(int csPin, SpiDevice& device) {
+  _devices.push_back(std::unique_ptr<Attachment>(new Attachment { csPin, &device, 0u, false }));
+  Attachment* attachment = _devices.back().get();
+  attachment->observer = addDigitalWriteObserver(csPin, [attachment](int value) {
+    bool selected = value == LOW;
+    if (selected != attachment->selected) {
+      attachment->selected = selected;
+      if (selected) {
+        attachment->device->select();
+      } else {
+        attachment->device->deselect();
+      }
+    }
+  });
+}
+
+void SPIClass::detachDevice(SpiDevice& device) {
+  for (auto it = _devices.begin(); it != _devices.end();) {
+    if ((*it)->device == &device) {
+      removeDigitalWriteObserver((*it)->observer);
+      it = _devices.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SPIClass::detachAllDevices() {
+  for (const auto& attachment : _devices) {
+    removeDigitalWriteObserver(attachment->observer);
+  }
+  _devices.clear();
+}
@@ -0,0 +1,67 @@
+#ifndef YATEST_BUSMOCK_H_
+#define YATEST_BUSMOCK_H_
+
+#include "Arduino.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Common parts of the Wire (I2C) and SPI mocks: the transaction log and a
+// register map to build simulated devices from.
+
+// Bus transaction log: while enabled, every I2C transmission/request and SPI
+// transfer is recorded with the current micros(). The bytes are kept in one
+// shared pool, so logging does not allocate per transaction.
+enum struct BusTransactionType : uint8_t {
+    I2cWrite,       // Wire.beginTransmission() ... endTransmission()
+    I2cRead,        // Wire.requestFrom()
+    SpiTransfer
+};
+
+struct BusTransaction {
+    unsigned long micros;
+    BusTransactionType type;
+    uint16_t address;       // I2C address or SPI chip select pin (NOT_A_PIN if none)
+    uint8_t status;         // Result of endTransmission() (0 = success)
+    std::size_t sentLength;     // Bytes from the master (I2C write, SPI MOSI)
+    std::size_t receivedLength; // Bytes to the master (I2C read, SPI MISO)
+    std::size_t offset;         // Position of the bytes in the pool
+};
+
+void startBusLog();
+void stopBusLog();
+void clearBusLog();
+std::size_t getBusLogSize();
+const BusTransaction& getBusTransaction(std::size_t index);
+// Bytes of a logged transaction, valid until the next transaction is logged.
+const uint8_t* getBusTransactionSent(const BusTransaction& transaction);
+const uint8_t* getBusTransactionReceived(const BusTransaction& transaction);
+
+// 256 byte registers with auto-incrementing bulk access, the base of typical
+// sensor and memory chip models. onRead is called before a register is read
+// (e.g. to update a measurement from micros()), onWrite after a register was
+// written (e.g. to start a measurement). Without callbacks, bulk accesses are
+// plain memory copies.
+class RegisterMap {
+public:
+    uint8_t registers[256] {};
+    std::function<void(uint8_t reg)> onRead {};
+    std::function<void(uint8_t reg, uint8_t value)> onWrite {};
+
+    virtual ~RegisterMap() = default;
+
+    void readRegisters(uint8_t reg, uint8_t* buffer, std::size_t length);
+    void writeRegisters(uint8_t reg, const uint8_t* buffer, std::size_t length);
+
+    // Big endian 16 bit helpers, e.g. for calibration data.
+    void setRegister16(uint8_t reg, uint16_t value) {
+        registers[reg] = static_cast<uint8_t>(value >> 8);
+        registers[static_cast<uint8_t>(reg + 1u)] = static_cast<uint8_t>(value);
+    }
+
+    uint16_t getRegister16(uint8_t reg) const {
+        return static_cast<uint16_t>(registers[reg] << 8 | registers[static_cast<uint8_t>(reg + 1u)]);
+    }
+};
+
+#endif // YATEST_BUSMOCK_H_
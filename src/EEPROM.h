@@ -0,0 +1,66 @@
+#ifndef YATEST_EEPROM_H_
+#define YATEST_EEPROM_H_
+
+#include "Arduino.h"
+#include "StorageMock.h"
+#include <cstddef>
+#include <cstdint>
+
+// Expose a mock EEPROM backend for tests: the content starts erased (0xff)
+// and can be backed by a memory mapped image file. Writes are counted per
+// cell to check wear (AVR EEPROM cells endure about 100k writes).
+void resetEepromMock(std::size_t size = 1024);
+bool openEepromImage(const char* path, std::size_t size = 1024);
+std::size_t getEepromWriteCount();
+uint32_t getEepromWriteCount(int address);
+uint32_t getEepromMaxWriteCount();
+
+// Reference to an EEPROM cell, e.g. EEPROM[0] = 42.
+struct EERef {
+    int index;
+
+    operator uint8_t() const;
+    EERef& operator=(uint8_t value);
+    EERef& operator=(const EERef& ref) { return *this = static_cast<uint8_t>(ref); }
+    EERef& update(uint8_t value);
+};
+
+// Mock of the Arduino EEPROM library (AVR and the emulated ESP variants with
+// begin()/commit()).
+class EEPROMClass {
+public:
+    void begin(std::size_t size);
+    bool commit() { return true; }
+    void end() {}
+
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length();
+    uint8_t* getDataPtr();
+
+    EERef operator[](int address) { return EERef { address }; }
+
+    template<typename T>
+    T& get(int address, T& value) {
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(&value);
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = read(address + static_cast<int>(i));
+        }
+        return value;
+    }
+
+    // Like on AVR, only changed bytes are written.
+    template<typename T>
+    const T& put(int address, const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            update(address + static_cast<int>(i), bytes[i]);
+        }
+        return value;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // YATEST_EEPROM_H_
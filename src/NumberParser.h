@@ -0,0 +1,132 @@
+#ifndef YATEST_NUMBERPARSER_H_
+#define YATEST_NUMBERPARSER_H_
+
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+// Number parsing shared by Stream::parseInt()/parseFloat() and
+// String::toInt()/toFloat(), with the semantics of atol()/atof() (leading
+// whitespace and a sign are accepted, parsing stops at the first other
+// character). Uses std::from_chars, which is locale independent and rounds
+// exactly, and strtod() for the forms it does not cover (hex floats) or if
+// the standard library lacks floating point support for it.
+
+inline const char* skipMockNumberPrefix(const char* begin, const char* end, bool& negative) {
+    while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) ++begin;
+    negative = begin < end && *begin == '-';
+    if (begin < end && (*begin == '-' || *begin == '+')) ++begin;
+    return begin;
+}
+
+// Saturates at LONG_MIN/LONG_MAX on overflow (like strtol()).
+inline long parseMockLong(const char* begin, const char* end) {
+    bool negative = false;
+    begin = skipMockNumberPrefix(begin, end, negative);
+    unsigned long magnitude = 0;
+    std::from_chars_result result = std::from_chars(begin, end, magnitude);
+    if (result.ec == std::errc::result_out_of_range || magnitude > static_cast<unsigned long>(LONG_MAX) + (negative ? 1u : 0u)) {
+        return negative ? LONG_MIN : LONG_MAX;
+    }
+    if (result.ec != std::errc()) {
+        return 0;
+    }
+    return negative ? static_cast<long>(0u - magnitude) : static_cast<long>(magnitude);
+}
+
+// Plain decimals with up to this many digits (most test inputs) are
+// converted exactly with one division: the mantissa and the power of ten are
+// both exact doubles then, so the division rounds correctly.
+constexpr int MOCK_SHORT_DECIMAL_DIGITS = 15;
+
+inline double mockShortDecimal(unsigned long long mantissa, int fractionDigits, bool negative) {
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    double value = static_cast<double>(mantissa) / powersOfTen[fractionDigits > 0 ? fractionDigits : 0];
+    return negative ? -value : value;
+}
+
+// Returns false for anything but a plain decimal of up to 15 digits.
+inline bool parseMockShortDecimal(const char* begin, const char* end, double& value) {
+    bool negative = begin < end && *begin == '-';
+    if (negative) ++begin;
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int fractionDigits = -1;
+    for (; begin < end; ++begin) {
+        if (*begin >= '0' && *begin <= '9') {
+            mantissa = mantissa * 10u + static_cast<unsigned>(*begin - '0');
+            digits += 1;
+            if (fractionDigits >= 0) fractionDigits += 1;
+        } else if (*begin == '.' && fractionDigits < 0) {
+            fractionDigits = 0;
+        } else {
+            return false;
+        }
+    }
+    if (digits == 0 || digits > MOCK_SHORT_DECIMAL_DIGITS) {
+        return false;
+    }
+    value = mockShortDecimal(mantissa, fractionDigits, negative);
+    return true;
+}
+
+inline double parseMockDouble(const char* begin, const char* end) {
+    double value = 0.0;
+    if (parseMockShortDecimal(begin, end, value)) {
+        return value;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    bool negative = false;
+    const char* digits = skipMockNumberPrefix(begin, end, negative);
+    if (digits < end && (*digits == '-' || *digits == '+')) {
+        return 0.0;
+    }
+    bool isHex = end - digits > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X');
+    std::from_chars_result result = std::from_chars(digits, end, value);
+    if (!isHex && result.ec == std::errc()) {
+        return negative ? -value : value;
+    }
+    if (!isHex && result.ec == std::errc::invalid_argument) {
+        return 0.0;
+    }
+#endif
+    // Out of range (HUGE_VAL or 0 with the right sign), hex or no from_chars.
+    std::string copy(begin, end);
+    return std::strtod(copy.c_str(), nullptr);
+}
+
+// Number scanned by Stream::parseInt()/parseFloat(): its text (a '-',
+// digits and at most one '.') and the value accumulated on the way, which is
+// used as it is for up to MOCK_SHORT_DECIMAL_DIGITS digits (nearly all), so
+// only longer numbers take a second pass over the text.
+struct MockScannedNumber {
+    const char* begin;
+    const char* end;
+    unsigned long long mantissa;
+    int digits;
+    int fractionDigits; // -1 without '.'
+    bool negative;
+    size_t droppedDigits; // Integer digits which did not fit the text
+
+    // Saturates at LONG_MIN/LONG_MAX (long before the text is full).
+    long toLong() const {
+        if (digits <= MOCK_SHORT_DECIMAL_DIGITS && mantissa <= static_cast<unsigned long long>(LONG_MAX)) {
+            return negative ? -static_cast<long>(mantissa) : static_cast<long>(mantissa);
+        }
+        return parseMockLong(begin, end);
+    }
+
+    double toDouble() const {
+        if (digits <= MOCK_SHORT_DECIMAL_DIGITS && droppedDigits == 0) {
+            return digits > 0 ? mockShortDecimal(mantissa, fractionDigits, negative) : 0.0;
+        }
+        double value = parseMockDouble(begin, end);
+        return droppedDigits > 0 ? value * std::pow(10.0, static_cast<double>(droppedDigits)) : value;
+    }
+};
+
+#endif // YATEST_NUMBERPARSER_H_
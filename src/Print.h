@@ -1,10 +1,16 @@
 #ifndef PRINT_H
 #define PRINT_H
 
+#include "Arduino.h"
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
 #include <cstdarg>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cwchar>
+#include <vector>
 
 // Mock Print class for non-Arduino compilation
 // Provides the interface expected by Arduino libraries
@@ -19,20 +25,13 @@ public:
   // Write string
   virtual size_t write(const char* str) {
     if (!str) return 0;
-    size_t len = strlen(str);
-    for (size_t i = 0; i < len; i++) {
-      write((uint8_t)str[i]);
-    }
-    return len;
+    return write(str, strlen(str));
   }
 
-  // Write buffer with size (const char*)
+  // Write buffer with size (const char*), to the bulk write of the sink as in
+  // the Arduino cores
   virtual size_t write(const char* buffer, size_t size) {
-    size_t written = 0;
-    for (size_t i = 0; i < size; i++) {
-      written += write((uint8_t)buffer[i]);
-    }
-    return written;
+    return write(reinterpret_cast<const uint8_t*>(buffer), size);
   }
 
   // Write buffer with size (const uint8_t*)
@@ -44,6 +43,14 @@ public:
     return written;
   }
 
+protected:
+  // Count bytes printed for cost estimation (see countMockCall())
+  static size_t counted(size_t written) {
+    countMockCall(MockCall::PrintWrite, written);
+    return written;
+  }
+
+public:
   // Stream compatibility
   virtual int availableForWrite() {
     return -1;  // Unknown
@@ -51,59 +58,59 @@ public:
 
   // Print single character
   size_t print(char c) {
-    return write((uint8_t)c);
+    return counted(write((uint8_t)c));
   }
 
   // Print string
   size_t print(const char* str) {
-    return write(str);
+    return counted(write(str));
   }
 
   // Print flash string helper
   size_t print(const __FlashStringHelper* str) {
     if (!str) return 0;
     // For flash strings, just cast and write as regular string
-    return write((const char*)str);
+    return counted(write(yatest_progmem_ptr((const char*)str)));
   }
 
   // Print unsigned integer
   size_t print(unsigned int n) {
-    char buffer[11];
-    snprintf(buffer, sizeof(buffer), "%u", n);
-    return write(buffer);
+    char buffer[21];
+    snprintf(buffer, sizeof(buffer), "%lu", boardUnsignedInt(n));
+    return counted(write(buffer));
   }
 
   // Print signed integer
   size_t print(int n) {
-    char buffer[12];
-    snprintf(buffer, sizeof(buffer), "%d", n);
-    return write(buffer);
+    char buffer[21];
+    snprintf(buffer, sizeof(buffer), "%ld", boardInt(n));
+    return counted(write(buffer));
   }
 
   // Print unsigned long
   size_t print(unsigned long n) {
-    char buffer[11];
-    snprintf(buffer, sizeof(buffer), "%lu", n);
-    return write(buffer);
+    char buffer[21];
+    snprintf(buffer, sizeof(buffer), "%lu", boardUnsignedLong(n));
+    return counted(write(buffer));
   }
 
   // Print signed long
   size_t print(long n) {
-    char buffer[12];
-    snprintf(buffer, sizeof(buffer), "%ld", n);
-    return write(buffer);
+    char buffer[21];
+    snprintf(buffer, sizeof(buffer), "%ld", boardLong(n));
+    return counted(write(buffer));
   }
 
   // Print float/double
   size_t print(double d, int digits = 2) {
     char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%.*f", digits, d);
-    return write(buffer);
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, boardDouble(d));
+    return counted(write(buffer));
   }
 
   // Print with newline
   size_t println() {
-    return write("\n");
+    return counted(write("\n"));
   }
 
   size_t println(char c) {
@@ -134,18 +141,286 @@ public:
     return print(d, digits) + println();
   }
 
-  // Printf-like functionality
+  // Printf-like functionality: the output is written to the sink as it is
+  // formatted (literal text and strings in one bulk write each), so it is
+  // neither truncated nor buffered on the heap. Only a single numeric
+  // conversion longer than 511 characters (e.g. "%.600f") needs a heap buffer.
+#if defined(__GNUC__) || defined(__clang__)
+  __attribute__((format(printf, 2, 3)))
+#endif
   size_t printf(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    char buffer[256];
-    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    size_t written = vprintf(format, args);
     va_end(args);
-    if (len > 0) {
-      return write(buffer);
+    return written;
+  }
+
+  size_t vprintf(const char* format, va_list args) {
+    size_t written = 0;
+    va_list remaining;
+    va_copy(remaining, args);
+    while (*format != '\0') {
+      const char* percent = strchr(format, '%');
+      size_t literalLength = percent != nullptr ? static_cast<size_t>(percent - format) : strlen(format);
+      if (literalLength > 0) {
+        written += write(format, literalLength);
+      }
+      if (percent == nullptr) {
+        break;
+      }
+      format = formatConversion(percent, &remaining, written);
+    }
+    va_end(remaining);
+    return counted(written);
+  }
+
+  // Type safe formatting: each "{}" in the format is replaced by the next
+  // argument, printed like with print() ("{{" and "}}" print braces). The
+  // arguments keep their types (no varargs), the placeholders are matched
+  // with them while the format is scanned: surplus "{}" are printed as is,
+  // surplus arguments are not printed.
+  template<typename... Args>
+  size_t format(const char* pattern, const Args&... args) {
+    size_t written = 0;
+    formatNext(pattern, written, args...);
+    return written;
+  }
+
+private:
+  // Reads a width or precision, saturating at INT_MAX.
+  static int readDigits(const char*& p) {
+    int value = 0;
+    for (; *p >= '0' && *p <= '9'; ++p) {
+      int digit = *p - '0';
+      value = value > (INT_MAX - digit) / 10 ? INT_MAX : value * 10 + digit;
+    }
+    return value;
+  }
+
+  // Writes the conversion at spec (after its '%'), returns the format
+  // position after it.
+  const char* formatConversion(const char* spec, va_list* argsPointer, size_t& written) {
+    va_list& args = *argsPointer;
+    const char* p = spec + 1;
+    char flags[8];
+    size_t flagCount = 0;
+    while (*p != '\0' && strchr("-+ #0", *p) != nullptr) {
+      if (flagCount + 1 < sizeof(flags)) flags[flagCount++] = *p;
+      ++p;
+    }
+    flags[flagCount] = '\0';
+    bool hasWidth = true;
+    bool hasStar = false;
+    int width = 0;
+    if (*p == '*') {
+      hasStar = true;
+      width = va_arg(args, int);
+      ++p;
+    } else if (*p >= '0' && *p <= '9') {
+      width = readDigits(p);
+    } else {
+      hasWidth = false;
+    }
+    int precision = -1;
+    if (*p == '.') {
+      ++p;
+      if (*p == '*') {
+        hasStar = true;
+        precision = va_arg(args, int);
+        ++p;
+      } else {
+        precision = readDigits(p);
+      }
+    }
+    char length[3] = {};
+    size_t lengthCount = 0;
+    while (*p != '\0' && lengthCount < 2 && strchr("hljztL", *p) != nullptr) {
+      length[lengthCount++] = *p++;
+    }
+    char conversion = *p;
+    if (conversion == '\0') {
+      written += write(spec, static_cast<size_t>(p - spec));
+      return p;
+    }
+    ++p;
+
+    // Conversion spec for snprintf, with * resolved (a negative width is the
+    // '-' flag followed by the width, a negative precision is ignored)
+    char single[48];
+    size_t specLength = static_cast<size_t>(p - spec);
+    if (!hasStar && specLength < sizeof(single)) {
+      memcpy(single, spec, specLength);
+      single[specLength] = '\0';
+    } else {
+      int singleLength = snprintf(single, sizeof(single), "%%%s", flags);
+      if (hasWidth) singleLength += snprintf(single + singleLength, sizeof(single) - singleLength, "%d", width);
+      if (precision >= 0) singleLength += snprintf(single + singleLength, sizeof(single) - singleLength, ".%d", precision);
+      snprintf(single + singleLength, sizeof(single) - singleLength, "%s%c", length, conversion);
     }
-    return 0;
+    // Plain integers (no flags, width or precision) skip snprintf
+    bool isPlain = specLength == 2 + lengthCount;
+
+    bool isLong = length[0] == 'l' && length[1] == '\0';
+    bool isLongLong = length[0] == 'l' && length[1] == 'l';
+    switch (conversion) {
+      case '%':
+        written += write("%", 1);
+        break;
+      case 'd': case 'i':
+        if (isLongLong) written += writeConversion(single, va_arg(args, long long));
+        else if (isLong && isPlain) written += writeDecimal(va_arg(args, long));
+        else if (isLong) written += writeConversion(single, va_arg(args, long));
+        else if (lengthCount == 0 && isPlain) written += writeDecimal(va_arg(args, int));
+        else if (length[0] == 'j') written += writeConversion(single, va_arg(args, intmax_t));
+        else if (length[0] == 'z' || length[0] == 't') written += writeConversion(single, va_arg(args, ptrdiff_t));
+        else written += writeConversion(single, va_arg(args, int));
+        break;
+      case 'u': case 'o': case 'x': case 'X':
+        if (isLongLong) written += writeConversion(single, va_arg(args, unsigned long long));
+        else if (isLong && isPlain && conversion == 'u') written += writeDecimal(va_arg(args, unsigned long));
+        else if (isLong) written += writeConversion(single, va_arg(args, unsigned long));
+        else if (lengthCount == 0 && isPlain && conversion == 'u') written += writeDecimal(va_arg(args, unsigned int));
+        else if (length[0] == 'j') written += writeConversion(single, va_arg(args, uintmax_t));
+        else if (length[0] == 'z' || length[0] == 't') written += writeConversion(single, va_arg(args, size_t));
+        else written += writeConversion(single, va_arg(args, unsigned int));
+        break;
+      case 'c':
+        written += isLong ? writeConversion(single, va_arg(args, wint_t)) : writeConversion(single, va_arg(args, int));
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        if (length[0] == 'L') written += writeConversion(single, va_arg(args, long double));
+        else written += writeConversion(single, va_arg(args, double));
+        break;
+      case 'p':
+        written += writeConversion(single, va_arg(args, void*));
+        break;
+      case 's':
+        if (isLong) {
+          written += writeConversion(single, va_arg(args, const wchar_t*));
+        } else {
+          written += writeString(va_arg(args, const char*), flags, hasWidth, width, precision);
+        }
+        break;
+      case 'n':
+        if (isLongLong) *va_arg(args, long long*) = static_cast<long long>(written);
+        else if (isLong) *va_arg(args, long*) = static_cast<long>(written);
+        else if (length[0] == 'h' && length[1] == 'h') *va_arg(args, signed char*) = static_cast<signed char>(written);
+        else if (length[0] == 'h') *va_arg(args, short*) = static_cast<short>(written);
+        else if (length[0] == 'z') *va_arg(args, size_t*) = written;
+        else *va_arg(args, int*) = static_cast<int>(written);
+        break;
+      default:
+        // Unknown conversion: print the spec like glibc does
+        written += write(spec, static_cast<size_t>(p - spec));
+        break;
+    }
+    return p;
+  }
+
+  template<typename T>
+  size_t writeDecimal(T value) {
+    char buffer[24];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return write(buffer, static_cast<size_t>(result.ptr - buffer));
+  }
+
+  template<typename T>
+  size_t writeConversion(const char* spec, T value) {
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), spec, value);
+    if (length <= 0) {
+      return 0;
+    }
+    if (static_cast<size_t>(length) < sizeof(buffer)) {
+      return write(buffer, static_cast<size_t>(length));
+    }
+    std::vector<char> large(static_cast<size_t>(length) + 1);
+    snprintf(large.data(), large.size(), spec, value);
+    return write(large.data(), static_cast<size_t>(length));
   }
+
+  // %s straight from the argument, padded in place
+  size_t writeString(const char* str, const char* flags, bool hasWidth, int width, int precision) {
+    if (str == nullptr) {
+      str = "(null)";
+    }
+    size_t length = 0;
+    while ((precision < 0 || length < static_cast<size_t>(precision)) && str[length] != '\0') {
+      ++length;
+    }
+    bool leftAligned = strchr(flags, '-') != nullptr || width < 0;
+    size_t fieldWidth = hasWidth ? static_cast<size_t>(width < 0 ? -static_cast<long>(width) : width) : 0;
+    size_t padding = fieldWidth > length ? fieldWidth - length : 0;
+    size_t written = 0;
+    if (!leftAligned) written += writePadding(padding);
+    written += write(str, length);
+    if (leftAligned) written += writePadding(padding);
+    return written;
+  }
+
+  size_t writePadding(size_t count) {
+    static const char spaces[] = "                                ";
+    size_t written = 0;
+    while (count > 0) {
+      size_t chunk = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+      written += write(spaces, chunk);
+      count -= chunk;
+    }
+    return written;
+  }
+
+  // Copies the format up to the next placeholder (handling escaped braces),
+  // returns the position after the placeholder or nullptr at the end.
+  const char* formatLiteral(const char* format, size_t& written) {
+    while (*format != '\0') {
+      const char* brace = strpbrk(format, "{}");
+      if (brace == nullptr) {
+        written += counted(write(format, strlen(format)));
+        return nullptr;
+      }
+      if (brace > format) {
+        written += counted(write(format, static_cast<size_t>(brace - format)));
+      }
+      if (brace[0] == '{' && brace[1] == '}') {
+        return brace + 2;
+      }
+      // "{{", "}}" or an unmatched brace: print one brace
+      written += counted(write(brace, 1));
+      format = brace + ((brace[1] == brace[0]) ? 2 : 1);
+    }
+    return nullptr;
+  }
+
+  void formatNext(const char* format, size_t& written) {
+    while (format != nullptr && *format != '\0') {
+      // More placeholders than arguments: print them as is
+      format = formatLiteral(format, written);
+      if (format != nullptr) {
+        written += counted(write("{}", 2));
+      }
+    }
+  }
+
+  template<typename T, typename... Args>
+  void formatNext(const char* format, size_t& written, const T& value, const Args&... args) {
+    format = formatLiteral(format, written);
+    if (format == nullptr) {
+      return;
+    }
+    written += formatArg(value);
+    formatNext(format, written, args...);
+  }
+
+  template<typename T>
+  auto formatArg(const T& value) -> decltype(print(value)) { return print(value); }
+  // String, std::string and the like
+  template<typename T>
+  auto formatArg(const T& value) -> decltype(value.c_str(), size_t()) { return print(value.c_str()); }
+  size_t formatArg(bool value) { return print(value ? "true" : "false"); }
+  size_t formatArg(long long value) { return printf("%lld", value); }
+  size_t formatArg(unsigned long long value) { return printf("%llu", value); }
+  size_t formatArg(const void* value) { return printf("%p", value); }
 };
 
 #endif // PRINT_H
@@ -0,0 +1,117 @@
+#ifndef YATEST_SPI_H_
+#define YATEST_SPI_H_
+
+#include "Arduino.h"
+#include "BusMock.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+// Simulated SPI device attached to the SPI mock with its (active low) chip
+// select pin. select()/deselect() are called when the code under test writes
+// the chip select LOW/HIGH, transfer() for all bytes clocked while selected.
+class SpiDevice {
+public:
+    virtual ~SpiDevice() = default;
+
+    virtual void select() {}
+    virtual void deselect() {}
+    // Full duplex transfer: the device receives out and responds with in.
+    virtual void transfer(const uint8_t* out, uint8_t* in, std::size_t length) = 0;
+};
+
+// Register based SPI device: the first byte after selecting it is the register
+// address, with readBit set for reads (e.g. 0x80 like most sensors). Further
+// bytes read or write consecutive registers.
+class SpiRegisterDevice : public SpiDevice, public RegisterMap {
+    uint8_t _readBit;
+    bool _addressed = false;
+    bool _reading = false;
+    uint8_t _pointer = 0;
+
+public:
+    explicit SpiRegisterDevice(uint8_t readBit = 0x80) : _readBit(readBit) {}
+
+    void select() override {
+        _addressed = false;
+    }
+
+    void transfer(const uint8_t* out, uint8_t* in, std::size_t length) override {
+        std::size_t start = 0;
+        if (!_addressed && length > 0) {
+            _reading = (out[0] & _readBit) != 0;
+            _pointer = static_cast<uint8_t>(out[0] & ~_readBit);
+            _addressed = true;
+            in[0] = 0xff;
+            start = 1;
+        }
+        if (_reading) {
+            readRegisters(_pointer, in + start, length - start);
+        } else {
+            writeRegisters(_pointer, out + start, length - start);
+            std::memset(in + start, 0xff, length - start);
+        }
+        _pointer = static_cast<uint8_t>(_pointer + (length - start));
+    }
+};
+
+class SPISettings {
+public:
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+
+    SPISettings() : SPISettings(4000000, MSBFIRST, SPI_MODE0) {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+};
+
+// Mock of the Arduino SPI library. Transfers are dispatched to the first
+// attached device whose chip select is LOW (bytes read 0xff if none is).
+class SPIClass {
+    struct Attachment {
+        int csPin;
+        SpiDevice* device;
+        std::size_t observer;
+        bool selected;
+    };
+
+    std::vector<std::unique_ptr<Attachment>> _devices {};
+    SPISettings _settings {};
+    bool _inTransaction = false;
+
+    SpiDevice* selectedDevice(int& csPin) const;
+
+public:
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings settings) { _settings = settings; _inTransaction = true; }
+    void endTransaction() { _inTransaction = false; }
+    void setBitOrder(uint8_t bitOrder) { _settings.bitOrder = bitOrder; }
+    void setDataMode(uint8_t dataMode) { _settings.dataMode = dataMode; }
+    void setClockDivider(uint8_t divider) { (void)divider; }
+    const SPISettings& getSettings() const { return _settings; }
+    bool isInTransaction() const { return _inTransaction; }
+
+    uint8_t transfer(uint8_t data);
+    uint16_t transfer16(uint16_t data);
+    // Bulk transfers, passed to the device in one call.
+    void transfer(void* buffer, size_t count);
+    void transferBytes(const uint8_t* out, uint8_t* in, uint32_t count);
+    void writeBytes(const uint8_t* data, uint32_t count);
+
+    // Simulated devices, which must outlive their attachment.
+    void attachDevice(int csPin, SpiDevice& device);
+    void detachDevice(SpiDevice& device);
+    void detachAllDevices();
+};
+
+extern SPIClass SPI;
+
+#endif // YATEST_SPI_H_
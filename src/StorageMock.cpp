@@ -0,0 +1,256 @@
+#include "StorageMock.h"
+#include "EEPROM.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define YATEST_HAS_MMAP 1
+#endif
+
+EEPROMClass EEPROM {};
+
+namespace {
+    struct EepromState {
+        StorageImage image { 1024, 0xff };
+        std::vector<uint32_t> writes = std::vector<uint32_t>(1024, 0u);
+        std::size_t writeTotal = 0u;
+    };
+
+    // EEPROM content is constructed on first use (not by a global
+    // initializer), so EEPROM also works from constructors of globals in
+    // other sources.
+    EepromState& eeprom() {
+        static EepromState state {};
+        return state;
+    }
+
+    inline bool isValidEepromAddress(int address) {
+        return address >= 0 && static_cast<std::size_t>(address) < eeprom().image.size();
+    }
+
+    std::size_t checkSectorSize(std::size_t sectorSize) {
+        if (sectorSize == 0) {
+            throw std::invalid_argument("FlashMock sector size must not be 0");
+        }
+        return sectorSize;
+    }
+}
+
+void StorageImage::allocate(std::size_t size, uint8_t fill) {
+  release();
+  _memory.assign(size, fill);
+  _data = _memory.data();
+  _size = size;
+}
+
+bool StorageImage::map(const char* path, std::size_t size, uint8_t fill) {
+  release();
+#ifdef YATEST_HAS_MMAP
+  int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 || (static_cast<std::size_t>(info.st_size) < size && ::ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+    ::close(fd);
+    return false;
+  }
+  void* mapping = size > 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : nullptr;
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  _data = static_cast<uint8_t*>(mapping);
+  _size = size;
+  _mapped = true;
+  std::size_t existing = static_cast<std::size_t>(info.st_size);
+  if (existing < size) {
+    std::memset(_data + existing, fill, size - existing);
+  }
+  return true;
+#else
+  (void)path;
+  (void)size;
+  (void)fill;
+  return false;
+#endif
+}
+
+void StorageImage::release() {
+#ifdef YATEST_HAS_MMAP
+  if (_mapped && _data != nullptr) {
+    ::munmap(_data, _size);
+  }
+#endif
+  _memory.clear();
+  _memory.shrink_to_fit();
+  _data = nullptr;
+  _size = 0;
+  _mapped = false;
+}
+
+FlashMock::FlashMock(std::size_t size, std::size_t sectorSize) : _sectorSize(checkSectorSize(sectorSize)) {
+  _image.allocate(size, 0xff);
+  resetCounters();
+}
+
+FlashMock::FlashMock(const char* imagePath, std::size_t size, std::size_t sectorSize) : _sectorSize(checkSectorSize(sectorSize)) {
+  if (!_image.map(imagePath, size, 0xff)) {
+    throw std::runtime_error(std::string("cannot map flash image ") + imagePath);
+  }
+  resetCounters();
+}
+
+bool FlashMock::read(uint32_t address, void* buffer, std::size_t length) const {
+  if (address > size() || length > size() - address) {
+    return false;
+  }
+  std::memcpy(buffer, _image.data() + address, length);
+  return true;
+}
+
+bool FlashMock::program(uint32_t address, const void* data, std::size_t length) {
+  if (address > size() || length > size() - address) {
+    return false;
+  }
+  const uint8_t* source = static_cast<const uint8_t*>(data);
+  uint8_t* target = _image.data() + address;
+  uint8_t missingErase = 0;
+  for (std::size_t i = 0; i < length; ++i) {
+    missingErase |= source[i] & ~target[i];
+    target[i] &= source[i];
+  }
+  if (missingErase != 0) {
+    _programErrors += 1u;
+  }
+  if (length > 0) {
+    for (std::size_t sector = address / _sectorSize; sector <= (address + length - 1) / _sectorSize; ++sector) {
+      _programCounts[sector] += 1u;
+    }
+  }
+  _bytesProgrammed += length;
+  return true;
+}
+
+bool FlashMock::eraseSector(std::size_t sector) {
+  if (sector >= sectorCount()) {
+    return false;
+  }
+  std::size_t begin = sector * _sectorSize;
+  std::memset(_image.data() + begin, 0xff, std::min(_sectorSize, size() - begin));
+  _eraseCounts[sector] += 1u;
+  return true;
+}
+
+bool FlashMock::erase(uint32_t address, std::size_t length) {
+  if (address % _sectorSize != 0 || length % _sectorSize != 0 || address > size() || length > size() - address) {
+    return false;
+  }
+  for (std::size_t sector = address / _sectorSize; sector < (address + length) / _sectorSize; ++sector) {
+    eraseSector(sector);
+  }
+  return true;
+}
+
+uint32_t FlashMock::getMaxEraseCount() const {
+  return _eraseCounts.empty() ? 0u : *std::max_element(_eraseCounts.begin(), _eraseCounts.end());
+}
+
+uint64_t FlashMock::getTotalEraseCount() const {
+  uint64_t total = 0u;
+  for (uint32_t count : _eraseCounts) {
+    total += count;
+  }
+  return total;
+}
+
+void FlashMock::resetCounters() {
+  std::size_t sectors = (size() + _sectorSize - 1) / _sectorSize;
+  _eraseCounts.assign(sectors, 0u);
+  _programCounts.assign(sectors, 0u);
+  _bytesProgrammed = 0;
+  _programErrors = 0;
+}
+
+void resetEepromMock(std::size_t size) {
+  EepromState& state = eeprom();
+  state.image.allocate(size, 0xff);
+  state.writes.assign(size, 0u);
+  state.writeTotal = 0u;
+}
+
+bool openEepromImage(const char* path, std::size_t size) {
+  EepromState& state = eeprom();
+  bool mapped = state.image.map(path, size, 0xff);
+  state.writes.assign(state.image.size(), 0u);
+  state.writeTotal = 0u;
+  return mapped;
+}
+
+std::size_t getEepromWriteCount() {
+  return eeprom().writeTotal;
+}
+
+uint32_t getEepromWriteCount(int address) {
+  return isValidEepromAddress(address) ? eeprom().writes[address] : 0u;
+}
+
+uint32_t getEepromMaxWriteCount() {
+  const std::vector<uint32_t>& writes = eeprom().writes;
+  return writes.empty() ? 0u : *std::max_element(writes.begin(), writes.end());
+}
+
+EERef::operator uint8_t() const {
+  return EEPROM.read(index);
+}
+
+EERef& EERef::operator=(uint8_t value) {
+  EEPROM.write(index, value);
+  return *this;
+}
+
+EERef& EERef::update(uint8_t value) {
+  EEPROM.update(index, value);
+  return *this;
+}
+
+void EEPROMClass::begin(std::size_t size) {
+  if (size != eeprom().image.size() && !eeprom().image.isMapped()) {
+    resetEepromMock(size);
+  }
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return isValidEepromAddress(address) ? eeprom().image.data()[address] : 0xff;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (!isValidEepromAddress(address)) {
+    return;
+  }
+  EepromState& state = eeprom();
+  state.image.data()[address] = value;
+  state.writes[address] += 1u;
+  state.writeTotal += 1u;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (read(address) != value) {
+    write(address, value);
+  }
+}
+
+uint16_t EEPROMClass::length() {
+  return static_cast<uint16_t>(eeprom().image.size());
+}
+
+uint8_t* EEPROMClass::getDataPtr() {
+  return eeprom().image.data();
+}
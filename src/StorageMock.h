@@ -0,0 +1,77 @@
+#ifndef YATEST_STORAGEMOCK_H_
+#define YATEST_STORAGEMOCK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Memory of a storage mock (EEPROM, flash), either allocated or a memory
+// mapped image file. With a file, tests work directly on its pages (nothing is
+// copied) and the content is kept for later runs or inspection.
+class StorageImage {
+    uint8_t* _data = nullptr;
+    std::size_t _size = 0;
+    std::vector<uint8_t> _memory {};
+    bool _mapped = false;
+
+public:
+    StorageImage() = default;
+    StorageImage(std::size_t size, uint8_t fill) { allocate(size, fill); }
+    StorageImage(const StorageImage&) = delete;
+    StorageImage& operator=(const StorageImage&) = delete;
+    ~StorageImage() { release(); }
+
+    void allocate(std::size_t size, uint8_t fill);
+    // Map an image file, which is created or extended (with the fill value) to
+    // the given size. Returns false if it cannot be mapped (not supported on
+    // non-POSIX systems), the image is empty then.
+    bool map(const char* path, std::size_t size, uint8_t fill);
+    void release();
+
+    uint8_t* data() { return _data; }
+    const uint8_t* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    bool isMapped() const { return _mapped; }
+};
+
+// NOR flash block device: reads anywhere, programming can only clear bits
+// (1 -> 0) and erasing sets a whole sector to 0xff. Erase and program cycles
+// are counted per sector to assert wear and write amplification, e.g. of a
+// LittleFS or wear leveling layer on top.
+class FlashMock {
+    StorageImage _image {};
+    std::size_t _sectorSize;
+    std::vector<uint32_t> _eraseCounts {};
+    std::vector<uint32_t> _programCounts {};
+    std::size_t _bytesProgrammed = 0;
+    std::size_t _programErrors = 0;
+
+public:
+    // Throws std::invalid_argument if the sector size is 0.
+    explicit FlashMock(std::size_t size, std::size_t sectorSize = 4096);
+    // Flash backed by a memory mapped image file (see StorageImage::map()).
+    // Throws std::runtime_error if the file cannot be mapped.
+    FlashMock(const char* imagePath, std::size_t size, std::size_t sectorSize = 4096);
+
+    bool read(uint32_t address, void* buffer, std::size_t length) const;
+    bool program(uint32_t address, const void* data, std::size_t length);
+    bool eraseSector(std::size_t sector);
+    // Erase all sectors of a sector aligned range.
+    bool erase(uint32_t address, std::size_t length);
+
+    std::size_t size() const { return _image.size(); }
+    std::size_t sectorSize() const { return _sectorSize; }
+    std::size_t sectorCount() const { return _eraseCounts.size(); }
+    const uint8_t* data() const { return _image.data(); }
+
+    uint32_t getEraseCount(std::size_t sector) const { return sector < _eraseCounts.size() ? _eraseCounts[sector] : 0; }
+    uint32_t getProgramCount(std::size_t sector) const { return sector < _programCounts.size() ? _programCounts[sector] : 0; }
+    uint32_t getMaxEraseCount() const;
+    uint64_t getTotalEraseCount() const;
+    std::size_t getBytesProgrammed() const { return _bytesProgrammed; }
+    // Programs which would have had to set bits (i.e. missed an erase).
+    std::size_t getProgramErrorCount() const { return _programErrors; }
+    void resetCounters();
+};
+
+#endif // YATEST_STORAGEMOCK_H_
@@ -3,45 +3,406 @@
 
 #include "Arduino.h"
 #include "WString.h"
+#include "NumberParser.h"
 #include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 // Base class for character and binary based streams
 class Stream {
 protected:
     unsigned long _timeout = 1000;
     unsigned long _startMillis;
+    signed char _peekBufferAPI = -1; // hasPeekBufferAPI(), once known
 
-    int timedRead() {
-        int c;
+    // hasPeekBufferAPI() is a property of the stream class, so it is asked
+    // once instead of with a virtual call per number parsed.
+    bool usesPeekBuffer() {
+        if (_peekBufferAPI < 0) {
+            _peekBufferAPI = hasPeekBufferAPI() ? 1 : 0;
+        }
+        return _peekBufferAPI != 0;
+    }
+
+    // Reads and peeks try the stream first and only start the timeout when no
+    // data is available. Waits advance the virtual clock in steps of a
+    // millisecond, so scheduled events can deliver data and timeouts end. The
+    // waits are accounted to the call site in the wait profile.
+    int timedRead(MockCallSite site) {
+        int c = read();
+        if (c < 0) {
+            c = waitRead(site);
+        }
+        if (c >= 0) {
+            countMockCall(MockCall::StreamRead);
+        }
+        return c;
+    }
+
+    int timedPeek(MockCallSite site) {
+        int c = peek();
+        return c >= 0 ? c : waitPeek(site);
+    }
+
+    YATEST_MOCK_NOINLINE int waitRead(MockCallSite site) {
         _startMillis = millis();
-        do {
-            c = read();
+        while (millis() - _startMillis < _timeout) {
+            waitMockTime(1000u, "Stream timeout", site);
+            int c = read();
             if (c >= 0) return c;
-        } while(millis() - _startMillis < _timeout);
+        }
         return -1;
     }
 
-    int timedPeek() {
-        int c;
+    YATEST_MOCK_NOINLINE int waitPeek(MockCallSite site) {
         _startMillis = millis();
-        do {
-            c = peek();
+        while (millis() - _startMillis < _timeout) {
+            waitMockTime(1000u, "Stream timeout", site);
+            int c = peek();
             if (c >= 0) return c;
-        } while(millis() - _startMillis < _timeout);
+        }
         return -1;
     }
 
-    int peekNextDigit() {
+    // Arduino signatures for subclasses, accounted to their caller
+    YATEST_MOCK_NOINLINE int timedRead() {
+        return timedRead(YATEST_MOCK_CALLER);
+    }
+
+    YATEST_MOCK_NOINLINE int timedPeek() {
+        return timedPeek(YATEST_MOCK_CALLER);
+    }
+
+    YATEST_MOCK_NOINLINE int peekNextDigit() {
+        return peekNextDigit(YATEST_MOCK_CALLER);
+    }
+
+    // Incremental Knuth-Morris-Pratt matcher: finding a pattern in n bytes takes
+    // O(n) steps, also if it overlaps itself (e.g. "aab" in "aaab").
+    class Matcher {
+        const char* _pattern;
+        size_t _length;
+        size_t _matched = 0;
+        size_t _inlineFailure[32];
+        std::vector<size_t> _heapFailure {};
+        size_t* _failure;
+
+    public:
+        Matcher(const char* pattern, size_t length) : _pattern(pattern), _length(length), _failure(_inlineFailure) {
+            if (length > sizeof(_inlineFailure) / sizeof(_inlineFailure[0])) {
+                _heapFailure.resize(length);
+                _failure = _heapFailure.data();
+            }
+            // _failure[i]: length of the longest proper prefix which is also a
+            // suffix of the first i + 1 pattern bytes.
+            size_t k = 0;
+            for (size_t i = 0; i < length; ++i) {
+                if (i == 0) {
+                    _failure[0] = 0;
+                    continue;
+                }
+                while (k > 0 && pattern[i] != pattern[k]) k = _failure[k - 1];
+                if (pattern[i] == pattern[k]) ++k;
+                _failure[i] = k;
+            }
+        }
+        Matcher(const Matcher&) = delete;
+        Matcher& operator=(const Matcher&) = delete;
+
+        bool isIdle() const { return _matched == 0; }
+
+        // Returns true when the byte completes the pattern.
+        bool feed(char c) {
+            while (_matched > 0 && c != _pattern[_matched]) _matched = _failure[_matched - 1];
+            if (c == _pattern[_matched]) ++_matched;
+            if (_matched < _length) return false;
+            _matched = _failure[_length - 1];
+            return true;
+        }
+    };
+
+    // Index of the next byte in [index, length) which can start a match.
+    static size_t skipToCandidate(const char* buffer, size_t index, size_t length, char first, char otherFirst) {
+        if (first == otherFirst) {
+            const void* candidate = memchr(buffer + index, first, length - index);
+            return candidate != nullptr ? static_cast<const char*>(candidate) - buffer : length;
+        }
+        while (index < length && buffer[index] != first && buffer[index] != otherFirst) ++index;
+        return index;
+    }
+
+    // Fast path of parseInt()/parseFloat() for streams with a peek buffer:
+    // scans the next number in place if it is complete (followed by another
+    // character) and plain (no skipChar or repeated '.'). Nothing is consumed,
+    // see consumeNumber().
+    bool peekNumber(char skipChar, bool isFloat, MockScannedNumber& number) {
+        size_t available = peekAvailable();
+        if (available == 0) return false;
+        const char* c = peekBuffer();
+        const char* end = c + available;
+        while (c < end && *c != '-' && (*c < '0' || *c > '9')) ++c;
+        if (c == end || *c == skipChar) return false;
+        const char* begin = c;
+        bool negative = *c == '-';
+        if (negative) ++c;
+        unsigned long long mantissa = 0;
+        int digits = 0;
+        int pointDigits = -1; // Digits before the '.'
+        for (; c < end; ++c) {
+            if (*c == skipChar) return false;
+            if (*c >= '0' && *c <= '9') {
+                mantissa = mantissa * 10u + static_cast<unsigned>(*c - '0');
+                digits += 1;
+            } else if (isFloat && *c == '.' && pointDigits < 0) {
+                pointDigits = digits;
+            } else {
+                break;
+            }
+        }
+        if (c == end || (isFloat && *c == '.')) return false;
+        number = MockScannedNumber { begin, c, mantissa, digits, pointDigits >= 0 ? digits - pointDigits : -1, negative, 0 };
+        return true;
+    }
+
+    void consumeNumber(const MockScannedNumber& number) {
+        size_t consumed = number.end - peekBuffer();
+        peekConsume(consumed);
+        countMockCall(MockCall::StreamRead, consumed);
+    }
+
+    // Consumes the characters of a decimal number (a leading '-', digits and
+    // '.', with skipChar in between) and collects them without skipChar and
+    // repeated '.' into text, skipping other characters before it like
+    // peekNextDigit(). Scans the peek buffer in bulk if the stream has one.
+    // Integer digits beyond the capacity are counted as dropped, fraction
+    // digits beyond it are ignored.
+    MockScannedNumber scanNumber(char skipChar, char* text, size_t capacity, MockCallSite site) {
+        // Kept in locals (also the read count), so they stay in registers
+        // across the virtual calls per character
+        size_t length = 0;
+        size_t droppedDigits = 0;
+        unsigned long long mantissa = 0;
+        int digits = 0;
+        int fractionDigits = -1;
+        auto isNumberChar = [&](int c) {
+            return (c >= '0' && c <= '9') || c == skipChar || c == '.';
+        };
+        auto append = [&](char c) {
+            if (c == skipChar) return;
+            if (c == '.') {
+                if (fractionDigits >= 0) return;
+                fractionDigits = 0;
+            } else if (c != '-') {
+                mantissa = mantissa * 10u + static_cast<unsigned>(c - '0');
+                digits += 1;
+                if (fractionDigits >= 0) fractionDigits += 1;
+            }
+            if (length + 1 < capacity) {
+                text[length++] = c;
+            } else if (fractionDigits < 0) {
+                droppedDigits += 1;
+            }
+        };
+
+        int c = peekNextDigit(site);
+        bool hasPeekBuffer = c >= 0 && usesPeekBuffer();
+        size_t consumed = 0;
+        while (c >= 0) {
+            append((char)c);
+            read();
+            consumed += 1;
+            size_t available = hasPeekBuffer ? peekAvailable() : 0;
+            if (available > 0) {
+                const char* buffer = peekBuffer();
+                size_t index = 0;
+                while (index < available && isNumberChar((unsigned char)buffer[index])) {
+                    append(buffer[index++]);
+                }
+                peekConsume(index);
+                consumed += index;
+                if (index < available) break;
+            }
+            c = timedPeek(site);
+            if (!isNumberChar(c)) break;
+        }
+        countMockCall(MockCall::StreamRead, consumed);
+        bool negative = length > 0 && text[0] == '-';
+        return MockScannedNumber { text, text + length, mantissa, digits, fractionDigits, negative, droppedDigits };
+    }
+
+    // Consumes a decimal number like scanNumber(), a character at a time, for
+    // streams without a peek buffer.
+    double scanDouble(char skipChar, MockCallSite site) {
+        int c = peekNextDigit(site);
+        if (c < 0) return 0.0;
+        char text[64];
+        size_t length = 0;
+        size_t droppedDigits = 0;
+        unsigned long long mantissa = 0;
+        int digits = 0;
+        int point = -1; // digits before the '.'
+        size_t consumed = 0;
+        bool negative = c == '-' && c != skipChar;
+        if (negative) {
+            text[length++] = '-';
+            read();
+            consumed = 1;
+            c = timedPeek(site);
+        }
+        while (true) {
+            if (c >= '0' && c <= '9' && c != skipChar) {
+                mantissa = mantissa * 10u + static_cast<unsigned>(c - '0');
+                digits += 1;
+                if (length + 1 < sizeof(text)) {
+                    text[length++] = (char)c;
+                } else if (point < 0) {
+                    droppedDigits += 1;
+                }
+            } else if (c == '.' && c != skipChar) {
+                if (point < 0) {
+                    point = digits;
+                    if (length + 1 < sizeof(text)) text[length++] = '.';
+                }
+            } else if (c < 0 || c != skipChar) {
+                break;
+            }
+            read();
+            consumed += 1;
+            c = timedPeek(site);
+        }
+        countMockCall(MockCall::StreamRead, consumed);
+        int fractionDigits = point < 0 ? -1 : digits - point;
+        return MockScannedNumber { text, text + length, mantissa, digits, fractionDigits, negative, droppedDigits }.toDouble();
+    }
+
+    // Consumes an integer (a leading '-' and digits, with skipChar in between)
+    // like scanNumber(), for streams without a peek buffer or numbers which
+    // are not complete in it. Saturates at LONG_MIN/LONG_MAX.
+    long scanLong(char skipChar, MockCallSite site) {
+        int c = peekNextDigit(site);
+        if (c < 0) return 0;
+        bool negative = c == '-' && c != skipChar;
+        unsigned long magnitude = 0;
+        bool overflow = false;
+        size_t consumed = 0;
+        if (negative) {
+            read();
+            consumed = 1;
+            c = timedPeek(site);
+        }
+        // Numbers this short cannot overflow, only longer ones are checked
+        size_t unchecked = consumed + std::numeric_limits<unsigned long>::digits10;
+        while ((c >= '0' && c <= '9') || c == skipChar) {
+            if (c != skipChar) {
+                if (consumed >= unchecked && magnitude > (ULONG_MAX - 9u) / 10u) {
+                    overflow = true;
+                } else {
+                    magnitude = magnitude * 10u + static_cast<unsigned>(c - '0');
+                }
+            }
+            read();
+            consumed += 1;
+            c = timedPeek(site);
+        }
+        countMockCall(MockCall::StreamRead, consumed);
+        if (overflow || magnitude > static_cast<unsigned long>(LONG_MAX) + (negative ? 1u : 0u)) {
+            return negative ? LONG_MIN : LONG_MAX;
+        }
+        return negative ? static_cast<long>(0u - magnitude) : static_cast<long>(magnitude);
+    }
+
+    int peekNextDigit(MockCallSite site) {
         int c;
         while (1) {
-            c = timedPeek();
+            c = timedPeek(site);
             if (c < 0) return c;
             if (c == '-') return c;
             if (c >= '0' && c <= '9') return c;
             read();
+            countMockCall(MockCall::StreamRead);
         }
     }
 
+    // Consumes the stream up to and including the target (returns true), the
+    // terminator (returns false) or until the timeout. Runs in O(n) for any
+    // pattern and scans the peek buffer directly if the stream has one.
+    bool findUntilAt(const char* target, size_t targetLen, const char* terminator, size_t termLen, MockCallSite site) {
+        if (terminator == nullptr) {
+            termLen = 0;
+        }
+        if (targetLen == 0) return true;
+        Matcher targetMatcher { target, targetLen };
+        Matcher termMatcher { terminator, termLen };
+
+        while (true) {
+            size_t length = usesPeekBuffer() ? peekAvailable() : 0;
+            if (length > 0) {
+                const char* buffer = peekBuffer();
+                size_t index = 0;
+                int found = -1;
+                while (index < length && found < 0) {
+                    if (targetMatcher.isIdle() && termMatcher.isIdle()) {
+                        index = skipToCandidate(buffer, index, length, target[0], termLen > 0 ? terminator[0] : target[0]);
+                        if (index == length) break;
+                    }
+                    char c = buffer[index++];
+                    if (targetMatcher.feed(c)) {
+                        found = 1;
+                    } else if (termLen > 0 && termMatcher.feed(c)) {
+                        found = 0;
+                    }
+                }
+                peekConsume(index);
+                countMockCall(MockCall::StreamRead, index);
+                if (found >= 0) return found == 1;
+                continue;
+            }
+
+            int c = timedRead(site);
+            if (c < 0) return false;
+            if (targetMatcher.feed((char)c)) return true;
+            if (termLen > 0 && termMatcher.feed((char)c)) return false;
+        }
+    }
+
+    long parseIntAt(char skipChar, MockCallSite site) {
+        MockScannedNumber number;
+        if (usesPeekBuffer() && peekNumber(skipChar, false, number)) {
+            long value = number.toLong();
+            consumeNumber(number);
+            return value;
+        }
+        return scanLong(skipChar, site);
+    }
+
+    float parseFloatAt(char skipChar, MockCallSite site) {
+        if (!usesPeekBuffer()) {
+            return (float)scanDouble(skipChar, site);
+        }
+        MockScannedNumber number;
+        if (peekNumber(skipChar, true, number)) {
+            double value = number.toDouble();
+            consumeNumber(number);
+            return (float)value;
+        }
+        char text[64];
+        return (float)scanNumber(skipChar, text, sizeof(text), site).toDouble();
+    }
+
+    size_t readBytesUntilAt(char terminator, uint8_t* buffer, size_t length, MockCallSite site) {
+        if (length < 1) return 0;
+        size_t index = 0;
+        _startMillis = millis();
+        while (index < length) {
+            int c = timedRead(site);
+            if (c < 0 || c == terminator) break;
+            *buffer++ = (uint8_t)c;
+            index++;
+        }
+        return index;
+    }
+
 public:
     virtual ~Stream() {}
 
@@ -58,112 +419,61 @@ public:
         return _timeout;
     }
 
-    bool find(const char* target) {
-        return findUntil(target, nullptr);
+    // The blocking methods are not inlined, so their return address is the
+    // call site of the wait profile.
+    YATEST_MOCK_NOINLINE bool find(const char* target) {
+        return findUntilAt(target, strlen(target), nullptr, 0, YATEST_MOCK_CALLER);
     }
 
-    bool find(const char* target, size_t length) {
-        return findUntil(target, length, nullptr, 0);
+    YATEST_MOCK_NOINLINE bool find(const char* target, size_t length) {
+        return findUntilAt(target, length, nullptr, 0, YATEST_MOCK_CALLER);
     }
 
-    bool findUntil(const char* target, const char* terminator) {
-        return findUntil(target, strlen(target), terminator, strlen(terminator));
+    YATEST_MOCK_NOINLINE bool findUntil(const char* target, const char* terminator) {
+        return findUntilAt(target, strlen(target), terminator, terminator ? strlen(terminator) : 0, YATEST_MOCK_CALLER);
     }
 
-    bool findUntil(const char* target, size_t targetLen, const char* terminator, size_t termLen) {
-        if (terminator == nullptr) {
-            termLen = 0;
-        }
-        size_t index = 0;
-        size_t termIndex = 0;
-        int c;
-
-        _startMillis = millis();
-        while ((c = timedRead()) > 0) {
-            if (c == target[index]) {
-                if (++index >= targetLen) return true;
-            } else {
-                index = 0;
-            }
-            if (termLen > 0 && c == terminator[termIndex]) {
-                if (++termIndex >= termLen) return false;
-            } else {
-                termIndex = 0;
-            }
-        }
-        return false;
+    YATEST_MOCK_NOINLINE bool findUntil(const char* target, size_t targetLen, const char* terminator, size_t termLen) {
+        return findUntilAt(target, targetLen, terminator, termLen, YATEST_MOCK_CALLER);
     }
 
-    long parseInt() {
-        return parseInt('\0');
+    // Direct access to buffered input, which lets find() and findUntil() scan
+    // it in bulk (same API as the ESP8266 core). Streams with an internal
+    // buffer override all of these.
+    virtual bool hasPeekBufferAPI() const { return false; }
+    // Number of bytes readable from peekBuffer().
+    virtual size_t peekAvailable() { return 0; }
+    virtual const char* peekBuffer() { return nullptr; }
+    // Mark bytes of the peek buffer as read.
+    virtual void peekConsume(size_t consume) { (void)consume; }
+
+    YATEST_MOCK_NOINLINE long parseInt() {
+        return parseIntAt('\0', YATEST_MOCK_CALLER);
     }
 
-    long parseInt(char skipChar) {
-        bool isNegative = false;
-        long value = 0;
-        int c;
-
-        c = peekNextDigit();
-        if (c < 0) return 0;
-
-        do {
-            if (c == skipChar) {
-                // ignore this character
-            } else if (c == '-') {
-                isNegative = true;
-            } else if (c >= '0' && c <= '9') {
-                value = value * 10 + c - '0';
-            }
-            read();
-            c = timedPeek();
-        } while ((c >= '0' && c <= '9') || c == skipChar);
-
-        if (isNegative) value = -value;
-        return value;
+    YATEST_MOCK_NOINLINE long parseInt(char skipChar) {
+        return parseIntAt(skipChar, YATEST_MOCK_CALLER);
     }
 
-    float parseFloat() {
-        return parseFloat('\0');
+    YATEST_MOCK_NOINLINE float parseFloat() {
+        return parseFloatAt('\0', YATEST_MOCK_CALLER);
     }
 
-    float parseFloat(char skipChar) {
-        bool isNegative = false;
-        bool isFraction = false;
-        long value = 0;
-        int c;
-        float fraction = 1.0;
-
-        c = peekNextDigit();
-        if (c < 0) return 0;
-
-        do {
-            if (c == skipChar) {
-                // ignore
-            } else if (c == '-') {
-                isNegative = true;
-            } else if (c == '.') {
-                isFraction = true;
-            } else if (c >= '0' && c <= '9') {
-                value = value * 10 + c - '0';
-                if (isFraction) fraction *= 0.1;
-            }
-            read();
-            c = timedPeek();
-        } while ((c >= '0' && c <= '9') || c == '.' || c == skipChar);
-
-        float result = value * (isFraction ? fraction : 1.0);
-        return isNegative ? -result : result;
+    YATEST_MOCK_NOINLINE float parseFloat(char skipChar) {
+        return parseFloatAt(skipChar, YATEST_MOCK_CALLER);
     }
 
     size_t readBytes(char* buffer, size_t length) {
         return readBytes((uint8_t*)buffer, length);
     }
 
-    virtual size_t readBytes(uint8_t* buffer, size_t length) {
+    // Waits of the char overload are accounted to the call above.
+    YATEST_MOCK_NOINLINE virtual size_t readBytes(uint8_t* buffer, size_t length) {
+        MockCallSite site = YATEST_MOCK_CALLER;
         size_t count = 0;
         _startMillis = millis();
         while (count < length) {
-            int c = timedRead();
+            int c = timedRead(site);
             if (c < 0) break;
             *buffer++ = (uint8_t)c;
             count++;
@@ -171,39 +481,32 @@ public:
         return count;
     }
 
-    size_t readBytesUntil(char terminator, char* buffer, size_t length) {
-        return readBytesUntil(terminator, (uint8_t*)buffer, length);
+    YATEST_MOCK_NOINLINE size_t readBytesUntil(char terminator, char* buffer, size_t length) {
+        return readBytesUntilAt(terminator, (uint8_t*)buffer, length, YATEST_MOCK_CALLER);
     }
 
-    size_t readBytesUntil(char terminator, uint8_t* buffer, size_t length) {
-        if (length < 1) return 0;
-        size_t index = 0;
-        _startMillis = millis();
-        while (index < length) {
-            int c = timedRead();
-            if (c < 0 || c == terminator) break;
-            *buffer++ = (uint8_t)c;
-            index++;
-        }
-        return index;
+    YATEST_MOCK_NOINLINE size_t readBytesUntil(char terminator, uint8_t* buffer, size_t length) {
+        return readBytesUntilAt(terminator, buffer, length, YATEST_MOCK_CALLER);
     }
 
-    String readString() {
+    YATEST_MOCK_NOINLINE String readString() {
+        MockCallSite site = YATEST_MOCK_CALLER;
         String ret;
-        int c = timedRead();
+        int c = timedRead(site);
         while (c >= 0) {
             ret += (char)c;
-            c = timedRead();
+            c = timedRead(site);
         }
         return ret;
     }
 
-    String readStringUntil(char terminator) {
+    YATEST_MOCK_NOINLINE String readStringUntil(char terminator) {
+        MockCallSite site = YATEST_MOCK_CALLER;
         String ret;
-        int c = timedRead();
+        int c = timedRead(site);
         while (c >= 0 && c != terminator) {
             ret += (char)c;
-            c = timedRead();
+            c = timedRead(site);
         }
         return ret;
     }
@@ -0,0 +1,213 @@
+#ifndef YATEST_STRINGKERNELS_H_
+#define YATEST_STRINGKERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Byte kernels behind the String mock (case conversion and comparison,
+// character replacement, trimming and substring search), processing 32 (AVX2)
+// or 16 (SSE2) bytes per step where the compiler targets these instruction
+// sets, with scalar loops for the tail and other platforms. Case handling is
+// ASCII only, like tolower()/toupper() in the "C" locale used on the boards.
+namespace string_kernels {
+
+inline char asciiLower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c; }
+inline char asciiUpper(char c) { return (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c; }
+inline bool asciiSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+#if defined(__AVX2__)
+using Vector = __m256i;
+constexpr std::size_t VECTOR_SIZE = 32;
+inline Vector load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(p)); }
+inline void store(char* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<Vector*>(p), v); }
+inline Vector splat(char c) { return _mm256_set1_epi8(c); }
+inline Vector equal(Vector a, Vector b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vector greater(Vector a, Vector b) { return _mm256_cmpgt_epi8(a, b); }
+inline Vector add(Vector a, Vector b) { return _mm256_add_epi8(a, b); }
+inline Vector bitAnd(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+inline Vector bitOr(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+inline Vector bitAndNot(Vector a, Vector b) { return _mm256_andnot_si256(a, b); } // ~a & b
+inline Vector bitXor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+inline uint32_t mask(Vector v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+#define YATEST_STRING_KERNELS_SIMD 1
+#elif defined(__SSE2__)
+using Vector = __m128i;
+constexpr std::size_t VECTOR_SIZE = 16;
+inline Vector load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const Vector*>(p)); }
+inline void store(char* p, Vector v) { _mm_storeu_si128(reinterpret_cast<Vector*>(p), v); }
+inline Vector splat(char c) { return _mm_set1_epi8(c); }
+inline Vector equal(Vector a, Vector b) { return _mm_cmpeq_epi8(a, b); }
+inline Vector greater(Vector a, Vector b) { return _mm_cmpgt_epi8(a, b); }
+inline Vector add(Vector a, Vector b) { return _mm_add_epi8(a, b); }
+inline Vector bitAnd(Vector a, Vector b) { return _mm_and_si128(a, b); }
+inline Vector bitOr(Vector a, Vector b) { return _mm_or_si128(a, b); }
+inline Vector bitAndNot(Vector a, Vector b) { return _mm_andnot_si128(a, b); }
+inline Vector bitXor(Vector a, Vector b) { return _mm_xor_si128(a, b); }
+inline uint32_t mask(Vector v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+#define YATEST_STRING_KERNELS_SIMD 1
+#endif
+
+#ifdef YATEST_STRING_KERNELS_SIMD
+constexpr uint32_t FULL_MASK = VECTOR_SIZE == 32 ? 0xffffffffu : 0xffffu;
+
+// Lanes with first <= c <= last. Shifted by 0x80 - first, the range starts at
+// the smallest signed byte, so one signed comparison checks both bounds.
+inline Vector inRange(Vector v, char first, char last) {
+  Vector shifted = add(v, splat(static_cast<char>(0x80 - first)));
+  return greater(splat(static_cast<char>(0x80 + (last - first) + 1)), shifted);
+}
+
+// XOR 0x20 switches the case of letters in the given range.
+inline Vector switchCase(Vector v, char first, char last) {
+  return bitXor(v, bitAnd(inRange(v, first, last), splat(0x20)));
+}
+
+inline Vector spaces(Vector v) {
+  return bitOr(equal(v, splat(' ')), inRange(v, '\t', '\r'));
+}
+#endif
+
+inline void toLower(char* data, std::size_t length) {
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  for (; i + VECTOR_SIZE <= length; i += VECTOR_SIZE) {
+    store(data + i, switchCase(load(data + i), 'A', 'Z'));
+  }
+#endif
+  for (; i < length; ++i) data[i] = asciiLower(data[i]);
+}
+
+inline void toUpper(char* data, std::size_t length) {
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  for (; i + VECTOR_SIZE <= length; i += VECTOR_SIZE) {
+    store(data + i, switchCase(load(data + i), 'a', 'z'));
+  }
+#endif
+  for (; i < length; ++i) data[i] = asciiUpper(data[i]);
+}
+
+inline bool equalsIgnoreCase(const char* a, const char* b, std::size_t length) {
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  for (; i + VECTOR_SIZE <= length; i += VECTOR_SIZE) {
+    Vector lowerA = switchCase(load(a + i), 'A', 'Z');
+    Vector lowerB = switchCase(load(b + i), 'A', 'Z');
+    if (mask(equal(lowerA, lowerB)) != FULL_MASK) return false;
+  }
+#endif
+  for (; i < length; ++i) {
+    if (asciiLower(a[i]) != asciiLower(b[i])) return false;
+  }
+  return true;
+}
+
+inline void replace(char* data, std::size_t length, char find, char replacement) {
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  Vector findVector = splat(find);
+  Vector replacementVector = splat(replacement);
+  for (; i + VECTOR_SIZE <= length; i += VECTOR_SIZE) {
+    Vector v = load(data + i);
+    Vector matches = equal(v, findVector);
+    if (mask(matches) != 0) {
+      store(data + i, bitOr(bitAnd(matches, replacementVector), bitAndNot(matches, v)));
+    }
+  }
+#endif
+  for (; i < length; ++i) {
+    if (data[i] == find) data[i] = replacement;
+  }
+}
+
+// Number of leading whitespace characters.
+inline std::size_t leadingSpaces(const char* data, std::size_t length) {
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  for (; i + VECTOR_SIZE <= length; i += VECTOR_SIZE) {
+    uint32_t nonSpaces = ~mask(spaces(load(data + i))) & FULL_MASK;
+    if (nonSpaces != 0) return i + static_cast<std::size_t>(__builtin_ctz(nonSpaces));
+  }
+#endif
+  while (i < length && asciiSpace(data[i])) ++i;
+  return i;
+}
+
+// Number of trailing whitespace characters.
+inline std::size_t trailingSpaces(const char* data, std::size_t length) {
+  std::size_t end = length;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  for (; end >= VECTOR_SIZE; end -= VECTOR_SIZE) {
+    uint32_t nonSpaces = ~mask(spaces(load(data + end - VECTOR_SIZE))) & FULL_MASK;
+    if (nonSpaces != 0) return length - (end - VECTOR_SIZE + (31u - static_cast<std::size_t>(__builtin_clz(nonSpaces))) + 1u);
+  }
+#endif
+  while (end > 0 && asciiSpace(data[end - 1])) --end;
+  return length - end;
+}
+
+// Position of needle in haystack, or -1. Candidates are positions where both
+// the first and the last needle byte match (compared for a whole vector of
+// positions at once), so only few are verified with memcmp.
+inline long find(const char* haystack, std::size_t length, const char* needle, std::size_t needleLength) {
+  if (needleLength == 0) return 0;
+  if (needleLength > length) return -1;
+  if (needleLength == 1) {
+    const void* found = std::memchr(haystack, needle[0], length);
+    return found != nullptr ? static_cast<const char*>(found) - haystack : -1;
+  }
+  std::size_t last = length - needleLength; // Last possible start
+  std::size_t i = 0;
+#ifdef YATEST_STRING_KERNELS_SIMD
+  Vector first = splat(needle[0]);
+  Vector lastByte = splat(needle[needleLength - 1]);
+  for (; i + VECTOR_SIZE <= last + 1; i += VECTOR_SIZE) {
+    uint32_t candidates = mask(bitAnd(equal(load(haystack + i), first), equal(load(haystack + i + needleLength - 1), lastByte)));
+    while (candidates != 0) {
+      std::size_t position = i + static_cast<std::size_t>(__builtin_ctz(candidates));
+      if (std::memcmp(haystack + position + 1, needle + 1, needleLength - 2) == 0) return static_cast<long>(position);
+      candidates &= candidates - 1;
+    }
+  }
+#endif
+  for (; i <= last; ++i) {
+    if (haystack[i] == needle[0] && std::memcmp(haystack + i + 1, needle + 1, needleLength - 1) == 0) return static_cast<long>(i);
+  }
+  return -1;
+}
+
+// Position of the last occurrence of needle in haystack, or -1.
+inline long findLast(const char* haystack, std::size_t length, const char* needle, std::size_t needleLength) {
+  if (needleLength == 0) return static_cast<long>(length);
+  if (needleLength > length) return -1;
+  std::size_t end = length - needleLength + 1; // Possible starts are [0, end)
+#ifdef YATEST_STRING_KERNELS_SIMD
+  Vector first = splat(needle[0]);
+  Vector lastByte = splat(needle[needleLength - 1]);
+  for (; end >= VECTOR_SIZE; end -= VECTOR_SIZE) {
+    std::size_t i = end - VECTOR_SIZE;
+    uint32_t candidates = mask(bitAnd(equal(load(haystack + i), first), equal(load(haystack + i + needleLength - 1), lastByte)));
+    while (candidates != 0) {
+      std::size_t bit = 31u - static_cast<std::size_t>(__builtin_clz(candidates));
+      if (std::memcmp(haystack + i + bit, needle, needleLength) == 0) return static_cast<long>(i + bit);
+      candidates &= ~(1u << bit);
+    }
+  }
+#endif
+  while (end > 0) {
+    --end;
+    if (haystack[end] == needle[0] && std::memcmp(haystack + end, needle, needleLength) == 0) return static_cast<long>(end);
+  }
+  return -1;
+}
+
+}
+
+#endif // YATEST_STRINGKERNELS_H_
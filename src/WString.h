@@ -2,10 +2,77 @@
 #define YATEST_WSTRING_H_
 
 #include "Arduino.h"
+#include "NumberParser.h"
+#include "StringKernels.h"
 #include <string>
 #include <cstring>
 #include <cstdlib>
 
+// Non-owning, read-only view of characters, e.g. of a String (valid until it
+// is modified or destroyed). Not NUL terminated, so it has no c_str().
+class StringView {
+private:
+    const char* _data;
+    unsigned int _length;
+
+public:
+    StringView() : _data(""), _length(0) {}
+    StringView(const char* data, unsigned int length) : _data(data), _length(length) {}
+    StringView(const char* cstr) : _data(cstr ? cstr : ""), _length(cstr ? (unsigned int)strlen(cstr) : 0) {}
+
+    unsigned int length() const { return _length; }
+    const char* data() const { return _data; }
+    const char* begin() const { return _data; }
+    const char* end() const { return _data + _length; }
+    char charAt(unsigned int index) const { return index < _length ? _data[index] : '\0'; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    unsigned char equals(const StringView& s) const {
+        return _length == s._length && memcmp(_data, s._data, _length) == 0;
+    }
+    unsigned char equalsIgnoreCase(const StringView& s) const {
+        return _length == s._length && string_kernels::equalsIgnoreCase(_data, s._data, _length);
+    }
+    unsigned char operator==(const StringView& s) const { return equals(s); }
+    unsigned char operator!=(const StringView& s) const { return !equals(s); }
+    unsigned char startsWith(const StringView& prefix) const {
+        return _length >= prefix._length && memcmp(_data, prefix._data, prefix._length) == 0;
+    }
+    unsigned char endsWith(const StringView& suffix) const {
+        return _length >= suffix._length && memcmp(end() - suffix._length, suffix._data, suffix._length) == 0;
+    }
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const { return indexOf(StringView(&ch, 1), fromIndex); }
+    int indexOf(const StringView& s, unsigned int fromIndex = 0) const {
+        if (fromIndex > _length) return -1;
+        long pos = string_kernels::find(_data + fromIndex, _length - fromIndex, s._data, s._length);
+        return pos < 0 ? -1 : (int)(pos + fromIndex);
+    }
+
+    StringView substring(unsigned int beginIndex) const {
+        return substring(beginIndex, _length);
+    }
+    StringView substring(unsigned int beginIndex, unsigned int endIndex) const {
+        if (beginIndex > endIndex) {
+            unsigned int temp = beginIndex;
+            beginIndex = endIndex;
+            endIndex = temp;
+        }
+        if (endIndex > _length) endIndex = _length;
+        if (beginIndex > endIndex) beginIndex = endIndex;
+        return StringView(_data + beginIndex, endIndex - beginIndex);
+    }
+    StringView trimmed() const {
+        unsigned int start = (unsigned int)string_kernels::leadingSpaces(_data, _length);
+        unsigned int trailing = (unsigned int)string_kernels::trailingSpaces(_data + start, _length - start);
+        return StringView(_data + start, _length - start - trailing);
+    }
+
+    long toInt() const { return parseMockLong(begin(), end()); }
+    float toFloat() const { return (float)parseMockDouble(begin(), end()); }
+    double toDouble() const { return parseMockDouble(begin(), end()); }
+};
+
 // Mock Arduino String class using std::string internally
 class String {
 private:
@@ -14,44 +81,52 @@ private:
 public:
     // Constructors
     String() : _str() {}
-    String(const char* cstr) : _str(cstr ? cstr : "") {}
-    String(const std::string& str) : _str(str) {}
-    String(const String& str) : _str(str._str) {}
-    String(const __FlashStringHelper* str) : _str(reinterpret_cast<const char*>(str)) {}
-    String(char c) : _str(1, c) {}
+    String(const char* cstr) : _str(cstr ? cstr : "") { countMockCall(MockCall::StringOp); }
+    String(const std::string& str) : _str(str) { countMockCall(MockCall::StringOp); }
+    explicit String(const StringView& view) : _str(view.data(), view.length()) { countMockCall(MockCall::StringOp); }
+    String(const String& str) : _str(str._str) { countMockCall(MockCall::StringOp); }
+    String(const __FlashStringHelper* str) : _str(yatest_progmem_ptr(reinterpret_cast<const char*>(str))) { countMockCall(MockCall::StringOp); }
+    String(char c) : _str(1, c) { countMockCall(MockCall::StringOp); }
     String(unsigned char num, unsigned char base = 10) { 
+        countMockCall(MockCall::StringOp);
         char buf[34]; 
         ultoa(num, buf, base); 
         _str = buf; 
     }
     String(int num, unsigned char base = 10) { 
-        char buf[34]; 
-        itoa(num, buf, base); 
+        countMockCall(MockCall::StringOp);
+        char buf[66]; 
+        ltoa(boardInt(num), buf, base); 
         _str = buf; 
     }
     String(unsigned int num, unsigned char base = 10) { 
-        char buf[34]; 
-        utoa(num, buf, base); 
+        countMockCall(MockCall::StringOp);
+        char buf[66]; 
+        ultoa(boardUnsignedInt(num), buf, base); 
         _str = buf; 
     }
     String(long num, unsigned char base = 10) { 
-        char buf[34]; 
-        ltoa(num, buf, base); 
+        countMockCall(MockCall::StringOp);
+        char buf[66]; 
+        ltoa(boardLong(num), buf, base); 
         _str = buf; 
     }
     String(unsigned long num, unsigned char base = 10) { 
-        char buf[34]; 
-        ultoa(num, buf, base); 
+        countMockCall(MockCall::StringOp);
+        char buf[66]; 
+        ultoa(boardUnsignedLong(num), buf, base); 
         _str = buf; 
     }
     String(float num, unsigned char decimalPlaces = 2) {
+        countMockCall(MockCall::StringOp);
         char buf[33];
         dtostrf(num, (decimalPlaces + 2), decimalPlaces, buf);
         _str = buf;
     }
     String(double num, unsigned char decimalPlaces = 2) {
+        countMockCall(MockCall::StringOp);
         char buf[33];
-        dtostrf(num, (decimalPlaces + 2), decimalPlaces, buf);
+        dtostrf(boardDouble(num), (decimalPlaces + 2), decimalPlaces, buf);
         _str = buf;
     }
 
@@ -88,11 +163,12 @@ public:
     char* end() { return begin() + length(); }
     const char* begin() const { return _str.c_str(); }
     const char* end() const { return _str.c_str() + length(); }
+    operator StringView() const { return StringView(_str.data(), length()); }
 
     // Concatenation
-    String& operator+=(const String& rhs) { _str += rhs._str; return *this; }
-    String& operator+=(const char* cstr) { if (cstr) _str += cstr; return *this; }
-    String& operator+=(char c) { _str += c; return *this; }
+    String& operator+=(const String& rhs) { countMockCall(MockCall::StringOp); _str += rhs._str; return *this; }
+    String& operator+=(const char* cstr) { countMockCall(MockCall::StringOp); if (cstr) _str += cstr; return *this; }
+    String& operator+=(char c) { countMockCall(MockCall::StringOp); _str += c; return *this; }
     String& operator+=(unsigned char num) { return *this += String(num); }
     String& operator+=(int num) { return *this += String(num); }
     String& operator+=(unsigned int num) { return *this += String(num); }
@@ -141,11 +217,7 @@ public:
     unsigned char operator<=(const String& rhs) const { return _str <= rhs._str; }
     unsigned char operator>=(const String& rhs) const { return _str >= rhs._str; }
     unsigned char equalsIgnoreCase(const String& s) const {
-        if (length() != s.length()) return 0;
-        for (unsigned int i = 0; i < length(); i++) {
-            if (::tolower(charAt(i)) != ::tolower(s.charAt(i))) return 0;
-        }
-        return 1;
+        return length() == s.length() && string_kernels::equalsIgnoreCase(_str.data(), s._str.data(), length());
     }
     unsigned char startsWith(const String& prefix) const {
         return _str.length() >= prefix._str.length() && 
@@ -163,12 +235,10 @@ public:
 
     // Search
     int indexOf(char ch, unsigned int fromIndex = 0) const {
-        size_t pos = _str.find(ch, fromIndex);
-        return pos == std::string::npos ? -1 : (int)pos;
+        return indexOf(&ch, 1, fromIndex);
     }
     int indexOf(const String& str, unsigned int fromIndex = 0) const {
-        size_t pos = _str.find(str._str, fromIndex);
-        return pos == std::string::npos ? -1 : (int)pos;
+        return indexOf(str._str.data(), str._str.length(), fromIndex);
     }
     int lastIndexOf(char ch) const {
         size_t pos = _str.rfind(ch);
@@ -200,47 +270,111 @@ public:
         return String(_str.substr(beginIndex, endIndex - beginIndex));
     }
 
+    // Substring without copying, see StringView
+    StringView substringView(unsigned int beginIndex) const {
+        return StringView(*this).substring(beginIndex);
+    }
+    StringView substringView(unsigned int beginIndex, unsigned int endIndex) const {
+        return StringView(*this).substring(beginIndex, endIndex);
+    }
+
     // Modification
     void replace(char find, char replace) {
-        for (size_t i = 0; i < _str.length(); i++) {
-            if (_str[i] == find) _str[i] = replace;
-        }
+        countMockCall(MockCall::StringOp);
+        string_kernels::replace(&_str[0], _str.length(), find, replace);
     }
+    // Single pass over the matches, in place: replacements of the same or a
+    // shorter length are written while scanning forward, longer ones (after
+    // counting the matches and growing once) while scanning backward.
     void replace(const String& find, const String& replace) {
-        size_t pos = 0;
-        while ((pos = _str.find(find._str, pos)) != std::string::npos) {
-            _str.replace(pos, find._str.length(), replace._str);
-            pos += replace._str.length();
+        if (&find == this || &replace == this) {
+            String findCopy(find);
+            String replaceCopy(replace);
+            this->replace(findCopy, replaceCopy);
+            return;
+        }
+        countMockCall(MockCall::StringOp);
+        size_t findLength = find._str.length();
+        size_t replaceLength = replace._str.length();
+        if (findLength == 0 || findLength > _str.length()) return;
+        const char* findData = find._str.data();
+        const char* replaceData = replace._str.data();
+        if (replaceLength <= findLength) {
+            char* data = &_str[0];
+            size_t length = _str.length();
+            size_t read = 0;
+            size_t write = 0;
+            long pos;
+            while ((pos = string_kernels::find(data + read, length - read, findData, findLength)) >= 0) {
+                if (write != read) memmove(data + write, data + read, (size_t)pos);
+                write += (size_t)pos;
+                memcpy(data + write, replaceData, replaceLength);
+                write += replaceLength;
+                read += (size_t)pos + findLength;
+            }
+            if (write == read) return;
+            memmove(data + write, data + read, length - read);
+            _str.resize(write + length - read);
+            return;
+        }
+        size_t matches = 0;
+        long pos;
+        for (size_t read = 0; (pos = string_kernels::find(_str.data() + read, _str.length() - read, findData, findLength)) >= 0;
+             read += (size_t)pos + findLength) {
+            matches++;
+        }
+        if (matches == 0) return;
+        size_t length = _str.length();
+        _str.resize(length + matches * (replaceLength - findLength));
+        char* data = &_str[0];
+        // Like on Arduino, the matches are replaced from the end (which makes a
+        // difference for patterns overlapping themselves, "aa" in "aaa")
+        size_t read = length;
+        size_t write = _str.length();
+        while (matches > 0 && (pos = string_kernels::findLast(data, read, findData, findLength)) >= 0) {
+            size_t tail = read - ((size_t)pos + findLength);
+            write -= tail;
+            memmove(data + write, data + pos + findLength, tail);
+            write -= replaceLength;
+            memcpy(data + write, replaceData, replaceLength);
+            read = (size_t)pos;
+            matches--;
         }
     }
     void remove(unsigned int index) {
+        countMockCall(MockCall::StringOp);
         if (index < _str.length()) _str.erase(index);
     }
     void remove(unsigned int index, unsigned int count) {
+        countMockCall(MockCall::StringOp);
         if (index < _str.length()) _str.erase(index, count);
     }
     void toLowerCase() {
-        for (size_t i = 0; i < _str.length(); i++) {
-            _str[i] = (char)::tolower((unsigned char)_str[i]);
-        }
+        countMockCall(MockCall::StringOp);
+        string_kernels::toLower(&_str[0], _str.length());
     }
     void toUpperCase() {
-        for (size_t i = 0; i < _str.length(); i++) {
-            _str[i] = (char)::toupper((unsigned char)_str[i]);
-        }
+        countMockCall(MockCall::StringOp);
+        string_kernels::toUpper(&_str[0], _str.length());
     }
     void trim() {
-        size_t start = 0;
-        while (start < _str.length() && isSpace(_str[start])) start++;
-        size_t end = _str.length();
-        while (end > start && isSpace(_str[end - 1])) end--;
-        _str = _str.substr(start, end - start);
+        countMockCall(MockCall::StringOp);
+        size_t start = string_kernels::leadingSpaces(_str.data(), _str.length());
+        _str.erase(_str.length() - string_kernels::trailingSpaces(_str.data() + start, _str.length() - start));
+        _str.erase(0, start);
     }
 
     // Conversion to numbers
-    long toInt() const { return atol(_str.c_str()); }
-    float toFloat() const { return (float)atof(_str.c_str()); }
-    double toDouble() const { return atof(_str.c_str()); }
+    long toInt() const { return parseMockLong(begin(), end()); }
+    float toFloat() const { return (float)parseMockDouble(begin(), end()); }
+    double toDouble() const { return parseMockDouble(begin(), end()); }
+
+private:
+    int indexOf(const char* find, size_t findLength, unsigned int fromIndex) const {
+        if (fromIndex > _str.length()) return -1;
+        long pos = string_kernels::find(_str.data() + fromIndex, _str.length() - fromIndex, find, findLength);
+        return pos < 0 ? -1 : (int)(pos + fromIndex);
+    }
 };
 
 #endif // YATEST_WSTRING_H_
@@ -0,0 +1,102 @@
+#ifndef YATEST_WIRE_H_
+#define YATEST_WIRE_H_
+
+#include "Arduino.h"
+#include "Stream.h"
+#include "BusMock.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef BUFFER_LENGTH
+#define BUFFER_LENGTH 32
+#endif
+
+// Simulated I2C device attached to the Wire mock at an address.
+class I2cDevice {
+public:
+    virtual ~I2cDevice() = default;
+
+    // Bytes written by the master in one transmission. Return false to NACK.
+    virtual bool write(const uint8_t* data, std::size_t length) = 0;
+    // Fill the buffer with up to length bytes requested by the master and
+    // return how many were provided.
+    virtual std::size_t read(uint8_t* buffer, std::size_t length) = 0;
+};
+
+// Register based I2C device: the first byte of a transmission sets the
+// register pointer, further bytes are written to consecutive registers and
+// requests read from the pointer on (auto increment).
+class I2cRegisterDevice : public I2cDevice, public RegisterMap {
+    uint8_t _pointer = 0;
+
+public:
+    bool write(const uint8_t* data, std::size_t length) override {
+        if (length == 0) {
+            return true;
+        }
+        _pointer = data[0];
+        writeRegisters(_pointer, data + 1, length - 1);
+        _pointer = static_cast<uint8_t>(_pointer + (length - 1));
+        return true;
+    }
+
+    std::size_t read(uint8_t* buffer, std::size_t length) override {
+        readRegisters(_pointer, buffer, length);
+        _pointer = static_cast<uint8_t>(_pointer + length);
+        return length;
+    }
+};
+
+// Mock of the Arduino Wire (I2C master) library. Transmissions and requests
+// are dispatched to the devices attached at the respective address.
+class TwoWire : public Stream {
+    I2cDevice* _devices[128] {};
+    std::size_t _bufferSize = BUFFER_LENGTH;
+    uint8_t _txAddress = 0;
+    bool _transmitting = false;
+    std::vector<uint8_t> _txBuffer {};
+    std::vector<uint8_t> _rxBuffer {};
+    std::size_t _rxIndex = 0;
+    uint32_t _clock = 100000;
+
+public:
+    using Stream::write;
+    using Stream::readBytes;
+
+    void begin() {}
+    void begin(uint8_t address) { (void)address; }
+    void end() {}
+    void setClock(uint32_t clock) { _clock = clock; }
+    uint32_t getClock() const { return _clock; }
+    // Transmit/receive buffer size (BUFFER_LENGTH by default, like on AVR).
+    void setBufferSize(std::size_t size) { _bufferSize = size; }
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission(static_cast<uint8_t>(address)); }
+    // 0: success, 1: data too long, 2: NACK on address, 3: NACK on data
+    uint8_t endTransmission(bool sendStop = true);
+    std::size_t requestFrom(int address, int quantity, int sendStop = true);
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* data, size_t length) override;
+    int available() override { return static_cast<int>(_rxBuffer.size() - _rxIndex); }
+    int read() override { return _rxIndex < _rxBuffer.size() ? _rxBuffer[_rxIndex++] : -1; }
+    int peek() override { return _rxIndex < _rxBuffer.size() ? _rxBuffer[_rxIndex] : -1; }
+    // Bulk read of the received bytes (does not wait for more).
+    size_t readBytes(uint8_t* buffer, size_t length) override;
+    bool hasPeekBufferAPI() const override { return true; }
+    size_t peekAvailable() override { return _rxBuffer.size() - _rxIndex; }
+    const char* peekBuffer() override { return reinterpret_cast<const char*>(_rxBuffer.data()) + _rxIndex; }
+    void peekConsume(size_t consume) override { _rxIndex += std::min(consume, peekAvailable()); }
+
+    // Simulated devices, which must outlive their attachment.
+    void attachDevice(uint8_t address, I2cDevice& device) { _devices[address & 0x7f] = &device; }
+    void detachDevice(uint8_t address) { _devices[address & 0x7f] = nullptr; }
+    void detachAllDevices();
+};
+
+extern TwoWire Wire;
+
+#endif // YATEST_WIRE_H_
@@ -1,5 +1,35 @@
 #!/bin/bash
 # Build and run tests for a library.
+#
+# Usage: build-and-run.sh <library dir> [options] [test runner options]
+#
+# Options:
+#   --no-cache    Run all test suites, also those which passed before and whose
+#                 inputs did not change since (same as YATEST_NO_CACHE=1).
+#   -j, --jobs N  Number of parallel compiler invocations (same as YATEST_JOBS).
+#   --profile P   Build profile (same as YATEST_PROFILE), each built in its own
+#                 directory build/<profile>:
+#                   debug      -O0, debug info (default)
+#                   release    -O2 with link time optimization
+#                   asan       AddressSanitizer and UndefinedBehaviorSanitizer
+#                              (also accepted as asan+ubsan)
+#                   tsan       ThreadSanitizer
+#                   coverage   -O0 with coverage instrumentation (gcov)
+#   --unity N     Unity build: compile library and test sources in N batches
+#                 each (same as YATEST_UNITY_BATCHES), which saves parsing the
+#                 same headers over and over. Suite variables with the same name
+#                 in different test sources are renamed in the batches, and
+#                 batches which still fail to compile (e.g. due to other
+#                 clashing names) are compiled as separate sources instead.
+#   --progmem     Place PROGMEM data in a separate section and check that
+#                 pgm_read_*()/*_P() functions only access it (same as
+#                 YATEST_PROGMEM=1, ELF platforms only). Also reports the
+#                 static RAM and flash bytes of each library source.
+#   --watch       Watch the library sources and tests for changes and rebuild
+#                 and rerun the affected tests (last failures first) on every
+#                 change. Uses inotifywait if available, polls otherwise.
+#
+# Any other options are passed on to the test runner.
 
 set -e
 
@@ -8,16 +38,62 @@ if [ -z "$LIB_DIR" -o ! -d "$LIB_DIR" ]; then
     echo "Error: Library directory not specified."
     exit 1
 fi
+shift
+
+NO_CACHE="${YATEST_NO_CACHE:-0}"
+WATCH=0
+PROFILE="${YATEST_PROFILE:-debug}"
+UNITY_BATCHES="${YATEST_UNITY_BATCHES:-0}"
+PROGMEM="${YATEST_PROGMEM:-0}"
+JOBS="${YATEST_JOBS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)}"
+RUNNER_ARGS=()
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --no-cache) NO_CACHE=1 ;;
+        -j|--jobs) JOBS="$2"; shift ;;
+        --watch) WATCH=1 ;;
+        --profile) PROFILE="$2"; shift ;;
+        --unity) UNITY_BATCHES="$2"; shift ;;
+        --progmem) PROGMEM=1 ;;
+        *) RUNNER_ARGS+=("$1") ;;
+    esac
+    shift
+done
+
+# Build profile flags
+case "$PROFILE" in
+    debug)
+        PROFILE_FLAGS="-O0"
+        ;;
+    release)
+        PROFILE_FLAGS="-O2 -flto"
+        ;;
+    asan|asan+ubsan)
+        PROFILE=asan
+        PROFILE_FLAGS="-O1 -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=undefined"
+        ;;
+    tsan)
+        PROFILE_FLAGS="-O1 -fno-omit-frame-pointer -fsanitize=thread"
+        ;;
+    coverage)
+        PROFILE_FLAGS="-O0 --coverage"
+        ;;
+    *)
+        echo "Error: unknown build profile '$PROFILE' (expected debug, release, asan, tsan or coverage)."
+        exit 1
+        ;;
+esac
 
 SRC_DIR="$LIB_DIR/src"
 TEST_DIR="$LIB_DIR/test"
-BUILD_DIR="$LIB_DIR/build"
+BUILD_DIR="$LIB_DIR/build/$PROFILE"
 
 YATEST_SRC_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 
 echo "Building tests for library in $LIB_DIR..."
 echo "Sources: $SRC_DIR"
 echo "Tests: $TEST_DIR"
+echo "Profile: $PROFILE"
 
 # Read depends from library.properties (format: depends=lib1, lib2 (>=0.1.2), ...)
 DEPS_INCLUDES=""
@@ -39,7 +115,7 @@ if [ -f "$LIB_PROPERTIES" ]; then
                 echo "Error: dependency library not found at $DEP_DIR"
                 exit 1
             fi
-            
+
             DEPS_INCLUDES="$DEPS_INCLUDES -I$DEP_DIR/src"
             DEPS_SOURCES="$DEPS_SOURCES $(find "$DEP_DIR/src" -name "*.cpp" 2>/dev/null || true)"
         fi
@@ -48,42 +124,387 @@ fi
 
 # Compiler settings
 CXX="${CXX:-clang++}"
-CXXFLAGS="-std=c++17 -g -Wall -Wextra"
+CXXFLAGS="-std=c++17 -g -Wall -Wextra -pthread $PROFILE_FLAGS -DYATEST_BUILD_PROFILE=\"$PROFILE\""
+if [ "$PROGMEM" = "1" ]; then
+    CXXFLAGS="$CXXFLAGS -DYATEST_PROGMEM_SECTION"
+fi
 
 # Include paths
 INCLUDES="-I$YATEST_SRC_DIR -I$SRC_DIR -I$TEST_DIR $DEPS_INCLUDES"
 
+# Generated source of a unity batch including the given sources. Suite
+# variables (`static const yatest::TestSuite& Name = ...`) declared in more than
+# one source are renamed by a macro around the include.
+unity_batch_source() {
+    local index="$1"
+    shift
+    local source name seen=" "
+    echo "// Unity batch generated by build-and-run.sh, do not edit."
+    for source in "$@"; do
+        local renames=()
+        for name in $(grep -oE 'yatest::TestSuite[[:space:]]*&[[:space:]]*[A-Za-z_][A-Za-z0-9_]*' "$source" | sed -E 's/.*&[[:space:]]*//'); do
+            case "$seen" in
+                *" $name "*) renames+=("$name") ;;
+                *) seen="$seen$name " ;;
+            esac
+        done
+        for name in "${renames[@]}"; do
+            echo "#define $name ${name}_unity_$index"
+        done
+        echo "#include \"$source\""
+        for name in "${renames[@]}"; do
+            echo "#undef $name"
+        done
+        index=$((index + 1))
+    done
+}
+
+# Group the given sources into unity batches and print the batch sources to
+# compile instead. Sources are assigned to batches by a hash of their path, so
+# adding or removing a source only changes one batch. Batches which failed to
+# compile are replaced by their sources until any of them changes.
+unity_batches() {
+    local prefix="$1"
+    shift
+    local batches=() i source batch content key
+    mkdir -p "$UNITY_DIR"
+    for source in "$@"; do
+        i=$(( $(printf '%s' "$source" | cksum | cut -d' ' -f1) % UNITY_BATCHES ))
+        batches[$i]="${batches[$i]} $source"
+    done
+    for ((i = 0; i < UNITY_BATCHES; i++)); do
+        if [ -z "${batches[$i]}" ]; then
+            continue
+        fi
+        batch="$UNITY_DIR/${prefix}_$i.cpp"
+        content=$(unity_batch_source 0 ${batches[$i]})
+        key=$( (echo "$content"; cat ${batches[$i]}) | hash_files)
+        if grep --silent --line-regexp --fixed-strings "$batch $key" "$UNITY_DIR/fallback" 2>/dev/null; then
+            printf '%s\n' ${batches[$i]}
+            continue
+        fi
+        if [ "$(cat "$batch" 2>/dev/null)" != "$content" ]; then
+            echo "$content" > "$batch"
+        fi
+        echo "$key" > "$batch.key"
+        echo "$batch"
+    done
+}
+
 # Source files
-YATEST_SOURCES=$(find "$YATEST_SRC_DIR" -name "*.cpp" -not -name 'main.cpp' 2>/dev/null || true)
-LIB_SOURCES=$(find "$SRC_DIR" -name "*.cpp" 2>/dev/null || true)
-TEST_SOURCES=$(find "$TEST_DIR" -name "*.cpp" 2>/dev/null || true)
-
-# Use main.cpp from yatest if no main() is defined in test sources
-YATEST_MAIN_SOURCE=
-if ! grep --recursive --silent --extended-regexp '^\s*int\s+main\s*\(' "$TEST_DIR" 2>/dev/null; then
-    YATEST_MAIN_SOURCE="$YATEST_SRC_DIR/main.cpp"
-fi
+find_sources() {
+    YATEST_SOURCES=$(find "$YATEST_SRC_DIR" -name "*.cpp" -not -name 'main.cpp' 2>/dev/null || true)
+    LIB_SOURCES=$(find "$SRC_DIR" -name "*.cpp" 2>/dev/null || true)
+    TEST_SOURCES=$(find "$TEST_DIR" -name "*.cpp" 2>/dev/null || true)
+
+    # Use main.cpp from yatest if no main() is defined in test sources
+    YATEST_MAIN_SOURCE=
+    if ! grep --recursive --silent --extended-regexp '^\s*int\s+main\s*\(' "$TEST_DIR" 2>/dev/null; then
+        YATEST_MAIN_SOURCE="$YATEST_SRC_DIR/main.cpp"
+    fi
+
+    if [ "$UNITY_BATCHES" -gt 0 ]; then
+        LIB_SOURCES=$(unity_batches lib $LIB_SOURCES)
+        TEST_SOURCES=$(unity_batches test $TEST_SOURCES)
+    fi
+
+    ALL_SOURCES="$YATEST_SOURCES $YATEST_MAIN_SOURCE $DEPS_SOURCES $LIB_SOURCES $TEST_SOURCES"
+}
 
-# Compile and run tests
-mkdir -p "$BUILD_DIR"
+OBJ_DIR="$BUILD_DIR/obj"
+UNITY_DIR="$BUILD_DIR/unity"
+CACHE_FILE="$BUILD_DIR/test-cache"
+RESULTS_FILE="$BUILD_DIR/test-results"
+HISTORY_FILE="$BUILD_DIR/test-history"
+mkdir -p "$OBJ_DIR"
 
 output="$BUILD_DIR/tests"
 
-echo "Building tests..."
-echo $CXX $CXXFLAGS $INCLUDES $YATEST_SOURCES $YATEST_MAIN_SOURCE $DEPS_SOURCES $LIB_SOURCES $TEST_SOURCES -o $output
-if $CXX $CXXFLAGS $INCLUDES $YATEST_SOURCES $YATEST_MAIN_SOURCE $DEPS_SOURCES $LIB_SOURCES $TEST_SOURCES -o "$output"; then
+# Object file of a source file (named after the full path to avoid clashes).
+object_for() {
+    local name="${1#/}"
+    echo "$OBJ_DIR/${name//\//__}.o"
+}
+
+# Dependencies (source and headers) recorded by the compiler for an object file.
+dependencies_of() {
+    local depfile="${1%.o}.d"
+    if [ -f "$depfile" ]; then
+        awk '{ if (sub(/\\$/, "")) { printf "%s", $0 } else { print; exit } }' "$depfile" | cut -d: -f2-
+    fi
+}
+
+# Check whether an object file is missing or older than any of its dependencies.
+needs_compile() {
+    local object="$1"
+    [ -f "$object" -a -f "${object%.o}.d" ] || return 0
+    for dep in $(dependencies_of "$object"); do
+        if [ ! -e "$dep" -o "$dep" -nt "$object" ]; then
+            return 0
+        fi
+    done
+    return 1
+}
+
+compile() {
+    local object
+    object=$(object_for "$1")
+    echo "  $1"
+    $CXX $CXXFLAGS $INCLUDES -MMD -MP -c "$1" -o "$object"
+}
+
+# Print the static data of each library source: bytes which would be in SRAM
+# on AVR (.data, .bss and .rodata, as constants not in PROGMEM are copied to
+# RAM there) and in flash (the PROGMEM and PSTR() sections). Sizes are those
+# of the host (e.g. 8 byte pointers), so they are an estimate.
+print_memory_footprint() {
+    if ! command -v size > /dev/null; then
+        echo "Memory footprint not available ('size' from binutils not found)"
+        return
+    fi
+    echo "Memory footprint (host estimate):"
+    printf '%10s %10s  %s\n' "SRAM" "flash" "source"
+    local source object sizes sram flash mock_size total_sram=0 total_flash=0
+    for source in $LIB_SOURCES; do
+        object=$(object_for "$source")
+        sizes=$(size -A "$object" 2>/dev/null | awk '
+            $1 ~ /^\.(data|bss|rodata)/ { sram += $2 }
+            $1 ~ /^yatest_progmem/ { flash += $2 }
+            END { print sram + 0, flash + 0 }')
+        read -r sram flash <<< "$sizes"
+        # Without the per-source copies of the mocks' own globals
+        for mock_size in $(nm -S -C "$object" 2>/dev/null | awk '$4 ~ /^(Serial|SerialRxBuffer|SerialTxBuffer|GPIO_MOCK_MAX_PINS)$/ || /yatest_progmem_strings\(\)::strings$/ { print $2 }'); do
+            sram=$((sram - 16#$mock_size))
+        done
+        printf '%10d %10d  %s\n' "$sram" "$flash" "${source#$LIB_DIR/}"
+        total_sram=$((total_sram + sram))
+        total_flash=$((total_flash + flash))
+    done
+    printf '%10d %10d  %s\n' "$total_sram" "$total_flash" "total"
+}
+
+hash_files() {
+    if command -v sha256sum > /dev/null; then
+        cat "$@" | sha256sum | cut -d' ' -f1
+    elif command -v shasum > /dev/null; then
+        cat "$@" | shasum -a 256 | cut -d' ' -f1
+    else
+        cat "$@" | cksum | cut -d' ' -f1
+    fi
+}
+
+# Files defining the suites of a test source: the source itself and any files
+# from the test directory it includes (headers, or sources of a unity batch).
+suite_files_of() {
+    echo "$1"
+    for dep in $(dependencies_of "$(object_for "$1")"); do
+        case "$dep" in
+            "$1") ;;
+            "$TEST_DIR"/*) echo "$dep" ;;
+        esac
+    done
+}
+
+# Recompile everything if compiler or flags changed
+BUILD_FLAGS="$CXX $CXXFLAGS $INCLUDES"
+if [ "$(cat "$OBJ_DIR/flags" 2>/dev/null)" != "$BUILD_FLAGS" ]; then
+    rm -f "$OBJ_DIR"/*.o "$OBJ_DIR"/*.d
+    echo "$BUILD_FLAGS" > "$OBJ_DIR/flags"
+fi
+
+# Build the tests (recompiling only changed sources) and run them. Arguments
+# are passed on to the test runner in addition to RUNNER_ARGS.
+build_and_run() {
+    find_sources
+
+    echo "Building tests..."
+    local stale_sources=()
+    local objects=()
+    local source object
+    for source in $ALL_SOURCES; do
+        object=$(object_for "$source")
+        objects+=("$object")
+        if needs_compile "$object"; then
+            stale_sources+=("$source")
+        fi
+    done
+
+    if [ ${#stale_sources[@]} -gt 0 ]; then
+        export -f compile object_for
+        export CXX CXXFLAGS INCLUDES OBJ_DIR
+        if ! printf '%s\n' "${stale_sources[@]}" | xargs -P "$JOBS" -I{} bash -c 'compile "$1"' _ {}; then
+            # Retry unity batches which failed to compile as separate sources
+            local failed_batches=0
+            for source in "${stale_sources[@]}"; do
+                case "$source" in
+                    "$UNITY_DIR"/*)
+                        if needs_compile "$(object_for "$source")"; then
+                            echo "Unity batch $source failed to compile, compiling its sources separately..."
+                            echo "$source $(cat "$source.key")" >> "$UNITY_DIR/fallback"
+                            failed_batches=1
+                        fi
+                        ;;
+                esac
+            done
+            if [ $failed_batches -eq 1 ]; then
+                build_and_run "$@"
+                return $?
+            fi
+            echo "✗ tests compilation failed"
+            return 1
+        fi
+    fi
+
+    if [ "$PROGMEM" = "1" ]; then
+        print_memory_footprint
+    fi
+
+    if ! $CXX $CXXFLAGS "${objects[@]}" -o "$output"; then
+        echo "✗ tests compilation failed"
+        return 1
+    fi
+
+    # The standard test runner is required for caching and selecting suites
+    local runner_args=()
+    local cache_args=()
+    local cache_keys=()
+    if [ -n "$YATEST_MAIN_SOURCE" ]; then
+        # Recently failed and long running tests first, based on previous runs
+        runner_args=("${RUNNER_ARGS[@]}" "$@" --results "$RESULTS_FILE" --history "$HISTORY_FILE")
+
+        # Suites of test sources whose objects (and all shared objects) did not
+        # change since they last passed are reported as cached instead of run.
+        # The runner options (e.g. --board or --profile-waits) and compiler
+        # flags are part of the key, as they can change the results.
+        local shared_objects=()
+        for source in $YATEST_SOURCES $YATEST_MAIN_SOURCE $DEPS_SOURCES $LIB_SOURCES; do
+            shared_objects+=("$(object_for "$source")")
+        done
+        local shared_hash key file
+        shared_hash=$( (printf '%s\n' "$PROFILE" "$CXXFLAGS" "${RUNNER_ARGS[@]}"; cat "${shared_objects[@]}") | hash_files)
+        for source in $TEST_SOURCES; do
+            key=$(echo "$shared_hash $(hash_files "$(object_for "$source")")" | hash_files)
+            cache_keys+=("$key $source")
+            if [ "$NO_CACHE" != "1" ] && grep --silent --line-regexp --fixed-strings "$key $source" "$CACHE_FILE" 2>/dev/null; then
+                for file in $(suite_files_of "$source"); do
+                    cache_args+=(--cached "$file")
+                done
+            fi
+        done
+        rm -f "$RESULTS_FILE"
+    fi
+
     echo "Running tests..."
     if [ -n "$YATEST_COLOR" ]; then
-        if YATEST_COLOR="$YATEST_COLOR" "$output"; then
-            echo "✓ tests passed"
-        else
-            echo "✗ tests failed"
-        fi
-    elif "$output"; then
+        export YATEST_COLOR
+    fi
+    if "$output" "${cache_args[@]}" "${runner_args[@]}"; then
         echo "✓ tests passed"
     else
         echo "✗ tests failed"
     fi
-else
-    echo "✗ tests compilation failed"
+
+    # Remember test sources whose suites all passed (or were cached). Sources
+    # whose suites were not selected to run keep their previous entry.
+    if [ -f "$RESULTS_FILE" ]; then
+        local previous_cache entry passed ran
+        previous_cache=$(cat "$CACHE_FILE" 2>/dev/null || true)
+        : > "$CACHE_FILE"
+        for entry in "${cache_keys[@]}"; do
+            source="${entry#* }"
+            passed=0
+            ran=0
+            for file in $(suite_files_of "$source"); do
+                if awk -F'\t' -v file="$file" '$2 == file && $1 == "failed" { found = 1 } END { exit !found }' "$RESULTS_FILE"; then
+                    ran=1
+                    passed=0
+                    break
+                elif awk -F'\t' -v file="$file" '$2 == file { found = 1 } END { exit !found }' "$RESULTS_FILE"; then
+                    ran=1
+                    passed=1
+                fi
+            done
+            if [ $passed -eq 1 ] || { [ $ran -eq 0 ] && echo "$previous_cache" | grep --silent --line-regexp --fixed-strings "$entry"; }; then
+                echo "$entry" >> "$CACHE_FILE"
+            fi
+        done
+    fi
+}
+
+# Print (and wait for) the source and test files changed since the stamp file
+# was last touched.
+wait_for_changes() {
+    local changed=""
+    while [ -z "$changed" ]; do
+        if command -v inotifywait > /dev/null; then
+            inotifywait --quiet --quiet --recursive --event close_write,create,delete,move "$SRC_DIR" "$TEST_DIR" 2>/dev/null || sleep 1
+            sleep 0.2  # let editors finish writing related files
+        else
+            sleep 1
+        fi
+        changed=$(find "$SRC_DIR" "$TEST_DIR" -type f \( -name '*.cpp' -o -name '*.c' -o -name '*.h' -o -name '*.hpp' -o -name '*.ipp' \) -newer "$WATCH_STAMP" 2>/dev/null || true)
+        # Deleted files are not found, so treat them as a change of everything
+        if [ -z "$changed" ] && [ "$(find "$SRC_DIR" "$TEST_DIR" -type f 2>/dev/null | wc -l)" != "$WATCH_FILE_COUNT" ]; then
+            changed="$SRC_DIR"
+        fi
+    done
+    touch "$WATCH_STAMP"
+    WATCH_FILE_COUNT=$(find "$SRC_DIR" "$TEST_DIR" -type f 2>/dev/null | wc -l)
+    echo "$changed"
+}
+
+# Suite files of the tests affected by the given changed files: the changed
+# test sources and the test sources depending on changed headers. Changed
+# library sources affect all tests.
+affected_suite_files() {
+    local source changed dep
+    find_sources
+    for source in $TEST_SOURCES; do
+        for changed in "$@"; do
+            case "$changed" in
+                "$SRC_DIR"|"$SRC_DIR"/*.cpp|"$SRC_DIR"/*.c)
+                    suite_files_of "$source"
+                    continue 2
+                    ;;
+            esac
+            if [ "$changed" = "$source" ] || [ ! -f "$(object_for "$source")" ]; then
+                suite_files_of "$source"
+                continue 2
+            fi
+            for dep in $(dependencies_of "$(object_for "$source")"); do
+                if [ "$dep" = "$changed" ]; then
+                    suite_files_of "$source"
+                    continue 3
+                fi
+            done
+        done
+    done
+}
+
+if [ "$WATCH" != "1" ]; then
+    build_and_run || true
+    exit 0
 fi
+
+WATCH_STAMP="$BUILD_DIR/watch-stamp"
+touch "$WATCH_STAMP"
+WATCH_FILE_COUNT=$(find "$SRC_DIR" "$TEST_DIR" -type f 2>/dev/null | wc -l)
+build_and_run || true
+while true; do
+    echo "Watching $SRC_DIR and $TEST_DIR for changes..."
+    CHANGED=($(wait_for_changes))
+    echo
+    echo "Changed: ${CHANGED[*]}"
+
+    # Previously failed suites first, then the affected ones
+    FILE_ARGS=()
+    SELECTED=$( (awk -F'\t' '$1 == "failed" { print $2 }' "$RESULTS_FILE" 2>/dev/null; affected_suite_files "${CHANGED[@]}") | awk '!seen[$0]++')
+    for file in $SELECTED; do
+        FILE_ARGS+=(--file "$file")
+    done
+    if [ ${#FILE_ARGS[@]} -gt 0 ]; then
+        build_and_run "${FILE_ARGS[@]}" || true
+    else
+        build_and_run || true
+    fi
+done
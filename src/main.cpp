@@ -6,8 +6,13 @@
  */
 
 #include <yatest/TestRunner.h>
+#include <yatest/CostEstimate.h>
+#include <yatest/PerfCounters.h>
+#include <yatest/Stress.h>
+#include <yatest/WaitProfile.h>
 #include <cstring>
 #include <cstdlib>
+#include <random>
 
 namespace {
 
@@ -26,19 +31,81 @@ bool parseBoolEnv(const char* value, bool defaultValue) {
   return defaultValue;
 }
 
+const BoardProfile* findBoard(const char* name) {
+  if (std::strcmp(name, "uno") == 0) return &BOARD_UNO;
+  if (std::strcmp(name, "mega") == 0) return &BOARD_MEGA;
+  if (std::strcmp(name, "esp32") == 0) return &BOARD_ESP32;
+  if (std::strcmp(name, "rp2040") == 0) return &BOARD_RP2040;
+  if (std::strcmp(name, "generic") == 0) return &BOARD_GENERIC;
+  return nullptr;
+}
+
 }
 
 int main(int argc, char** argv) {
   yatest::setUseColor(parseBoolEnv(std::getenv("YATEST_COLOR"), yatest::useColorOutput()));
 
+  yatest::RunOptions options {};
+  yatest::StressOptions stress {};
+  bool hasSeed = false;
+
   // Command-line override
   for (int i = 1; i < argc; ++i) {
     if (std::strcmp(argv[i], "--no-color") == 0 || std::strcmp(argv[i], "--nocolor") == 0) {
       yatest::setUseColor(false);
     } else if (std::strcmp(argv[i], "--color") == 0) {
       yatest::setUseColor(true);
+    } else if (std::strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+      options.files.emplace_back(argv[++i]);
+    } else if (std::strcmp(argv[i], "--cached") == 0 && i + 1 < argc) {
+      options.cachedFiles.emplace_back(argv[++i]);
+    } else if (std::strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+      options.resultsFile = argv[++i];
+    } else if (std::strcmp(argv[i], "--sync-output") == 0) {
+      options.asyncOutput = false;
+    } else if (std::strcmp(argv[i], "--estimate-cost") == 0) {
+      yatest::enableCostEstimation();
+    } else if (std::strcmp(argv[i], "--perf-counters") == 0) {
+      if (!yatest::enablePerfCounters()) {
+        std::cerr << "Hardware performance counters are not available (not Linux, no PMU or kernel.perf_event_paranoid > 2), continuing without" << std::endl;
+      }
+    } else if (std::strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+      options.historyFile = argv[++i];
+    } else if (std::strcmp(argv[i], "--shuffle") == 0) {
+      options.shuffle = true;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      options.shuffle = true;
+      options.seed = std::strtoull(argv[++i], nullptr, 10);
+      hasSeed = true;
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      stress.repeat = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--until-fail") == 0) {
+      stress.untilFail = true;
+    } else if (std::strcmp(argv[i], "--stress-duration") == 0 && i + 1 < argc) {
+      stress.durationSeconds = std::strtod(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--parallel") == 0 && i + 1 < argc) {
+      stress.parallel = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      options.traceFile = argv[++i];
+      yatest::trace::setVirtualClock([]() { return micros(); });
+    } else if (std::strcmp(argv[i], "--profile-waits") == 0) {
+      yatest::enableWaitProfile();
+    } else if (std::strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      const BoardProfile* board = findBoard(argv[++i]);
+      if (board == nullptr) {
+        std::cerr << "Unknown board '" << argv[i] << "' (expected uno, mega, esp32, rp2040 or generic)" << std::endl;
+        return 1;
+      }
+      setBoard(*board);
     }
   }
 
-  return yatest::run();
+  if (options.shuffle && !hasSeed) {
+    options.seed = std::random_device {}();
+  }
+
+  if (stress.repeat > 0u || stress.untilFail || stress.durationSeconds > 0.0) {
+    return yatest::stress(options, stress);
+  }
+  return yatest::run(options);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define YATEST_H_
 
 #include "yatest/TestSuite.h"
+#include "yatest/Shared.h"
 #include "yatest/Expect.h"
 #include "yatest/Mocks.h"
 
@@ -0,0 +1,73 @@
+#ifndef YATEST_COSTESTIMATE_H_
+#define YATEST_COSTESTIMATE_H_
+
+#include "TestSuite.h"
+#include "../Arduino.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace yatest {
+
+/**
+ * Test probe estimating how long each test would take on the target board:
+ * the mock calls made by the test (see countMockCall()) weighted with the
+ * cycles per call of the current board profile, plus the time waited in
+ * delay(). The estimate is reported along with its parts, largest (i.e. the
+ * hot spots) first.
+ *
+ * This is a first-order model of the Arduino API calls only, the code in
+ * between is not accounted for. Boards without a clock (BOARD_GENERIC) report
+ * the call counts instead.
+ */
+class MockCostProbe final : public ITestProbe {
+  unsigned long long _counts[MOCK_CALL_KINDS] {};
+  unsigned long long _delayMicros = 0u;
+
+public:
+  void beforeTest() override {
+    std::copy(std::begin(_mock_call_counts), std::end(_mock_call_counts), std::begin(_counts));
+    _delayMicros = _mock_delay_micros;
+  }
+
+  void afterTest(std::vector<TestMetric>& metrics) override {
+    const BoardProfile& board = getBoard();
+    std::vector<TestMetric> parts {};
+    double totalMicros = 0.0;
+    for (std::size_t i = 0u; i < MOCK_CALL_KINDS; ++i) {
+      auto call = static_cast<MockCall>(i);
+      double count = static_cast<double>(_mock_call_counts[i] - _counts[i]);
+      if (board.clockHz == 0u) {
+        if (count > 0.0) {
+          parts.push_back(TestMetric { getMockCallName(call), count, "calls" });
+        }
+        continue;
+      }
+      double micros = count * board.callCycles[i] * 1e6 / board.clockHz;
+      if (call == MockCall::Delay) {
+        micros += static_cast<double>(_mock_delay_micros - _delayMicros);
+      }
+      if (micros > 0.0) {
+        parts.push_back(TestMetric { getMockCallName(call), micros, "µs" });
+        totalMicros += micros;
+      }
+    }
+    std::stable_sort(parts.begin(), parts.end(), [](const TestMetric& a, const TestMetric& b) { return a.value > b.value; });
+    if (board.clockHz != 0u) {
+      metrics.push_back(TestMetric { std::string("est. ") + board.name, totalMicros, "µs" });
+    }
+    metrics.insert(metrics.end(), parts.begin(), parts.end());
+  }
+};
+
+/**
+ * Report cost estimates for all tests run afterwards.
+ */
+inline void enableCostEstimation() {
+  static MockCostProbe probe {};
+  addTestProbe(probe);
+}
+
+}
+
+#endif
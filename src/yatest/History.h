@@ -0,0 +1,160 @@
+#ifndef YATEST_HISTORY_H_
+#define YATEST_HISTORY_H_
+
+#include "TestSuite.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace yatest {
+
+/**
+ * Durations and outcomes of tests in previous runs, kept in a file with one
+ * "<runs since failure>\t<duration µs>\t<file>\t<suite>\t<test>" line per
+ * test (and an empty test name for the suite as a whole). It is used to run
+ * suites which failed recently first (for quick feedback), the others keep
+ * their registration order. Tests within a suite keep their order, as they
+ * may build on each other. Durations are kept for inspection.
+ */
+class TestHistory final {
+public:
+  // Suites which failed in one of this many previous runs are run first.
+  static constexpr unsigned RECENT_FAILURE_RUNS = 3u;
+
+  struct Entry final {
+    unsigned runsSinceFailure = NEVER_FAILED;
+    double durationMicros = 0.0;
+  };
+
+private:
+  static constexpr unsigned NEVER_FAILED = 1000000u;
+
+  std::unordered_map<std::string, Entry> _entries {};
+
+  static std::string key(const ITestSuite& suite, const char* test) {
+    std::string key { suite.file() };
+    key += '\t';
+    key += suite.name();
+    key += '\t';
+    key += test;
+    return key;
+  }
+
+  static void update(Entry& entry, bool failed, double micros) {
+    if (failed) {
+      entry.runsSinceFailure = 0u;
+    } else if (entry.runsSinceFailure < NEVER_FAILED) {
+      entry.runsSinceFailure += 1u;
+    }
+    // Smoothed, so a single slow run (e.g. on a loaded machine) does not reorder suites
+    entry.durationMicros = entry.durationMicros > 0.0 ? 0.7 * entry.durationMicros + 0.3 * micros : micros;
+  }
+
+  // Recently failed (most recent first), the others keep their order.
+  static bool runsBefore(const Entry& a, const Entry& b) {
+    return std::min(a.runsSinceFailure, RECENT_FAILURE_RUNS) < std::min(b.runsSinceFailure, RECENT_FAILURE_RUNS);
+  }
+
+public:
+  /**
+   * Read the history from a file. A missing file or malformed lines are
+   * ignored (all tests are new then).
+   */
+  void load(const std::string& path) {
+    std::ifstream in { path };
+    std::string line {};
+    while (std::getline(in, line)) {
+      std::istringstream fields { line };
+      Entry entry {};
+      std::string testKey {};
+      if (fields >> entry.runsSinceFailure >> entry.durationMicros && fields.get() == '\t' && std::getline(fields, testKey) && !testKey.empty()) {
+        _entries[testKey] = entry;
+      }
+    }
+  }
+
+  /**
+   * Drop the entries of tests and suites which are no longer registered
+   * (removed or renamed), so they do not pile up in the file. Entries of
+   * suites which do not list their tests (see ITestSuite::testNames()) are
+   * kept as a whole.
+   */
+  void prune(const TestSuiteList& suites) {
+    std::unordered_set<std::string> registered {};
+    std::unordered_set<std::string> unlisted {};
+    for (ITestSuite* suite : suites) {
+      std::vector<const char*> tests = suite->testNames();
+      if (tests.empty()) {
+        unlisted.insert(key(*suite, ""));
+      }
+      registered.insert(key(*suite, ""));
+      for (const char* test : tests) {
+        registered.insert(key(*suite, test));
+      }
+    }
+    for (auto entry = _entries.begin(); entry != _entries.end();) {
+      const std::string& testKey = entry->first;
+      bool keep = registered.count(testKey) != 0u || unlisted.count(testKey.substr(0, testKey.rfind('\t') + 1u)) != 0u;
+      entry = keep ? std::next(entry) : _entries.erase(entry);
+    }
+  }
+
+  // Write the history, including tests which were not run this time.
+  bool save(const std::string& path) const {
+    std::ofstream out { path, std::ios::out | std::ios::trunc };
+    for (const auto& entry : _entries) {
+      out << entry.second.runsSinceFailure << "\t" << entry.second.durationMicros << "\t" << entry.first << "\n";
+    }
+    return static_cast<bool>(out);
+  }
+
+  Entry find(const ITestSuite& suite, const char* test) const {
+    auto entry = _entries.find(key(suite, test));
+    return entry != _entries.end() ? entry->second : Entry {};
+  }
+
+  // Entry of the suite as a whole (see record()).
+  Entry find(const ITestSuite& suite) const {
+    return find(suite, "");
+  }
+
+  /**
+   * Add the outcome of a suite run, for each test and for the suite as a
+   * whole (failed if any test failed, with the duration of the suite).
+   */
+  void record(const ITestSuite& suite, const TestSuiteResult& result) {
+    bool suiteFailed = false;
+    for (const TestResult& test : result.testResults()) {
+      suiteFailed = suiteFailed || test.status == TestStatus::Failed;
+      update(_entries[key(suite, test.name)], test.status == TestStatus::Failed, test.durationMicros + test.setupMicros);
+    }
+    update(_entries[key(suite, "")], suiteFailed, result.durationMicros());
+  }
+
+  void orderSuites(std::vector<ITestSuite*>& suites) const {
+    std::vector<Entry> entries {};
+    entries.reserve(suites.size());
+    for (ITestSuite* suite : suites) {
+      entries.push_back(find(*suite));
+    }
+    std::vector<std::size_t> order(suites.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return runsBefore(entries[a], entries[b]); });
+    std::vector<ITestSuite*> ordered {};
+    ordered.reserve(suites.size());
+    for (std::size_t index : order) {
+      ordered.push_back(suites[index]);
+    }
+    suites = std::move(ordered);
+  }
+};
+
+}
+
+#endif
@@ -7,15 +7,13 @@
 #include "../Stream.h"
 #include "../Print.h"
 
-// Additional helper functions for time advancement
+// Additional helper functions for time advancement (running scheduled events)
 inline void advanceTimeMs(unsigned long millis_delta) {
-  _test_millis += millis_delta;
-  _test_micros += millis_delta * 1000;
+  advanceMockTime(millis_delta * 1000);
 }
 
 inline void advanceTimeUs(unsigned long micros_delta) {
-  _test_micros += micros_delta;
-  _test_millis += micros_delta / 1000;
+  advanceMockTime(micros_delta);
 }
 
 // Legacy aliases for compatibility
@@ -0,0 +1,154 @@
+#ifndef YATEST_PERFCOUNTERS_H_
+#define YATEST_PERFCOUNTERS_H_
+
+#include "TestSuite.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define YATEST_HAS_PERF_EVENTS 1
+#endif
+
+namespace yatest {
+
+/**
+ * Test probe counting hardware events of each test with Linux perf events:
+ * instructions retired, CPU cycles, cache misses and branch misses (of the
+ * test process in user space). Unlike the wall clock duration, the number of
+ * instructions hardly varies between runs or with the load of the machine, so
+ * it can be compared against a baseline to catch regressions.
+ *
+ * Counters the machine or kernel does not provide (e.g. in VMs, or with
+ * kernel.perf_event_paranoid > 2) are left out; without any, the probe
+ * reports nothing and available() is false.
+ */
+class PerfCounterProbe final : public ITestProbe {
+  struct Counter {
+    const char* name;
+    const char* unit;
+    uint64_t config;
+    int fd;
+    uint64_t id;
+  };
+
+  std::vector<Counter> _counters {};
+  int _groupFd = -1;
+
+#ifdef YATEST_HAS_PERF_EVENTS
+  static int openCounter(uint64_t config, int groupFd) {
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+  }
+#endif
+
+  void open() {
+#ifdef YATEST_HAS_PERF_EVENTS
+    const Counter candidates[] = {
+      { "retired", "instructions", PERF_COUNT_HW_INSTRUCTIONS, -1, 0u },
+      { "cpu", "cycles", PERF_COUNT_HW_CPU_CYCLES, -1, 0u },
+      { "cache", "misses", PERF_COUNT_HW_CACHE_MISSES, -1, 0u },
+      { "branch", "misses", PERF_COUNT_HW_BRANCH_MISSES, -1, 0u },
+    };
+    for (const Counter& candidate : candidates) {
+      int fd = openCounter(candidate.config, _groupFd);
+      if (fd < 0) {
+        continue;
+      }
+      Counter counter = candidate;
+      counter.fd = fd;
+      if (ioctl(fd, PERF_EVENT_IOC_ID, &counter.id) != 0) {
+        close(fd);
+        continue;
+      }
+      if (_groupFd == -1) {
+        _groupFd = fd;
+      }
+      _counters.push_back(counter);
+    }
+#endif
+  }
+
+public:
+  PerfCounterProbe() {
+    open();
+  }
+
+  PerfCounterProbe(const PerfCounterProbe&) = delete;
+  PerfCounterProbe& operator=(const PerfCounterProbe&) = delete;
+
+  ~PerfCounterProbe() {
+#ifdef YATEST_HAS_PERF_EVENTS
+    for (const Counter& counter : _counters) {
+      close(counter.fd);
+    }
+#endif
+  }
+
+  bool available() const {
+    return !_counters.empty();
+  }
+
+  void beforeTest() override {
+#ifdef YATEST_HAS_PERF_EVENTS
+    if (_groupFd >= 0) {
+      ioctl(_groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(_groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  void afterTest(std::vector<TestMetric>& metrics) override {
+#ifdef YATEST_HAS_PERF_EVENTS
+    if (_groupFd < 0) {
+      return;
+    }
+    ioctl(_groupFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time enabled, time running, then value and id per counter
+    uint64_t values[3 + 2 * 4] {};
+    if (read(_groupFd, values, sizeof(values)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+      return;
+    }
+    // Scale up if the counters were multiplexed with other events
+    double scale = values[2] > 0u ? static_cast<double>(values[1]) / static_cast<double>(values[2]) : 1.0;
+    for (uint64_t i = 0u; i < values[0] && i < 4u; ++i) {
+      for (const Counter& counter : _counters) {
+        if (counter.id == values[3 + 2 * i + 1]) {
+          metrics.push_back(TestMetric { counter.name, static_cast<double>(values[3 + 2 * i]) * scale, counter.unit });
+        }
+      }
+    }
+#else
+    (void)metrics;
+#endif
+  }
+};
+
+/**
+ * Count hardware events for all tests run afterwards. Returns false (and
+ * adds no probe) if no counter is available.
+ */
+inline bool enablePerfCounters() {
+  static PerfCounterProbe probe {};
+  if (!probe.available()) {
+    return false;
+  }
+  addTestProbe(probe);
+  return true;
+}
+
+}
+
+#endif
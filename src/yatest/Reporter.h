@@ -0,0 +1,203 @@
+#ifndef YATEST_REPORTER_H_
+#define YATEST_REPORTER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace yatest {
+
+namespace detail {
+
+/**
+ * Bounded lock-free queue for one producer and one consumer thread: both
+ * only advance their own index (with release semantics), so pushing and
+ * popping never block each other.
+ */
+template<typename T, std::size_t Capacity>
+class SpscQueue final {
+  static_assert((Capacity & (Capacity - 1u)) == 0u, "capacity must be a power of two");
+
+  T _items[Capacity] {};
+  alignas(64) std::atomic<std::size_t> _head { 0u }; // Next to pop
+  alignas(64) std::atomic<std::size_t> _tail { 0u }; // Next to push
+
+public:
+  bool tryPush(T item) {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    _items[tail & (Capacity - 1u)] = std::move(item);
+    _tail.store(tail + 1u, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& item) {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = std::move(_items[head & (Capacity - 1u)]);
+    _head.store(head + 1u, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+  }
+};
+
+struct ReportJob {
+  virtual ~ReportJob() = default;
+  virtual void write(std::ostream& out) = 0;
+};
+
+template<typename F>
+struct CallableReportJob final : ReportJob {
+  F function;
+
+  template<typename G>
+  explicit CallableReportJob(G&& function) : function(std::forward<G>(function)) {}
+  void write(std::ostream& out) override { function(out); }
+};
+
+}
+
+/**
+ * Output layer of the test runner: report() takes a function formatting a
+ * part of the report (e.g. the results of a suite), which is run on a
+ * background thread writing into a buffer. The buffer goes to standard output
+ * whenever the reporter has caught up with the queued parts, but at least
+ * every flushInterval, so the tests never wait for the terminal or pipe.
+ *
+ * Without async, parts are formatted and written right away (at the suite
+ * boundaries), e.g. to keep them in order with output of the tests.
+ */
+class Reporter final {
+  static constexpr std::size_t QUEUE_CAPACITY = 1024u;
+
+  bool _async;
+  std::chrono::milliseconds _flushInterval;
+  detail::SpscQueue<detail::ReportJob*, QUEUE_CAPACITY> _queue {};
+  std::atomic<bool> _finished { false };
+  std::atomic<bool> _draining { false };
+  std::size_t _queued = 0u;                 // Parts queued (by the producer)
+  std::atomic<std::size_t> _flushed { 0u }; // Parts written to stdout and flushed
+  std::size_t _written = 0u;                // Parts written to the buffer (by the consumer)
+  std::ostringstream _buffer {};
+  std::thread _thread {};
+
+  void flush() {
+    const std::string& text = _buffer.str();
+    if (!text.empty()) {
+      std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+      _buffer.str(std::string {});
+    }
+    std::cout.flush();
+    _flushed.store(_written, std::memory_order_release);
+  }
+
+  void consume() {
+    auto lastFlush = std::chrono::steady_clock::now();
+    auto idleWait = std::chrono::microseconds(0);
+    bool pending = false;
+    while (true) {
+      detail::ReportJob* job = nullptr;
+      if (_queue.tryPop(job)) {
+        std::unique_ptr<detail::ReportJob> owned { job };
+        owned->write(_buffer);
+        _written += 1u;
+        pending = true;
+        idleWait = std::chrono::microseconds(0);
+        if (std::chrono::steady_clock::now() - lastFlush < _flushInterval) {
+          continue;
+        }
+      } else if (_finished.load(std::memory_order_acquire)) {
+        if (_queue.empty()) {
+          break;
+        }
+        continue;
+      }
+      if (pending) {
+        flush();
+        pending = false;
+        lastFlush = std::chrono::steady_clock::now();
+      }
+      // Back off while idle, up to a millisecond between polls (but not while
+      // the producer waits in drain())
+      if (idleWait.count() == 0 || _draining.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+        idleWait = std::chrono::microseconds(50);
+      } else {
+        std::this_thread::sleep_for(idleWait);
+        idleWait = std::min(idleWait * 2, std::chrono::microseconds(1000));
+      }
+    }
+    flush();
+  }
+
+public:
+  explicit Reporter(bool async = true, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100))
+      : _async(async), _flushInterval(flushInterval) {
+    if (_async) {
+      _thread = std::thread([this]() { consume(); });
+    }
+  }
+
+  Reporter(const Reporter&) = delete;
+  Reporter& operator=(const Reporter&) = delete;
+
+  ~Reporter() {
+    finish();
+  }
+
+  template<typename F>
+  void report(F&& function) {
+    if (!_async) {
+      function(_buffer);
+      flush();
+      return;
+    }
+    auto* job = new detail::CallableReportJob<typename std::decay<F>::type>(std::forward<F>(function));
+    while (!_queue.tryPush(job)) {
+      std::this_thread::yield();
+    }
+    _queued += 1u;
+  }
+
+  /**
+   * Wait until everything reported so far is written to standard output. The
+   * runner drains the reporter before each suite, so the output up to a test
+   * which crashes the process (or exits or hangs) is not lost.
+   */
+  void drain() {
+    if (!_thread.joinable()) {
+      return;
+    }
+    _draining.store(true, std::memory_order_release);
+    while (_flushed.load(std::memory_order_acquire) != _queued) {
+      std::this_thread::yield();
+    }
+    _draining.store(false, std::memory_order_release);
+  }
+
+  // Write all remaining output, the reporter cannot be used afterwards.
+  void finish() {
+    if (_thread.joinable()) {
+      _finished.store(true, std::memory_order_release);
+      _thread.join();
+    }
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef YATEST_SHARED_H_
+#define YATEST_SHARED_H_
+
+#include "TestSuite.h"
+#include <chrono>
+#include <mutex>
+#include <new>
+
+namespace yatest {
+
+/**
+ * Expensive fixture state which is constructed lazily on first access and then
+ * shared read-only by all tests (also when accessed from multiple threads).
+ *
+ *   static const yatest::Shared<std::vector<String>> Table([]() {
+ *     return loadTable();
+ *   });
+ *
+ *   ... Table->size() ...
+ *
+ * The time spent constructing the value is reported as setup time of the test
+ * which triggered the construction instead of as test time.
+ */
+template<typename T>
+class Shared final {
+  T (*_factory)();
+  mutable std::once_flag _once {};
+  alignas(T) mutable unsigned char _storage[sizeof(T)];
+  mutable const T* _value = nullptr;
+
+public:
+  explicit Shared(T (*factory)()) : _factory(factory) {}
+
+  Shared(const Shared&) = delete;
+  Shared& operator=(const Shared&) = delete;
+
+  ~Shared() {
+    if (_value != nullptr) {
+      _value->~T();
+    }
+  }
+
+  const T& get() const {
+    std::call_once(_once, [this]() {
+      using DurationMicros = std::chrono::duration<double, std::micro>;
+      auto traced = trace::scope("Shared construction", "fixture");
+      auto start = std::chrono::steady_clock::now();
+      _value = new (_storage) T(_factory());
+      detail::sharedSetupMicros() += DurationMicros(std::chrono::steady_clock::now() - start).count();
+    });
+    return *_value;
+  }
+
+  const T& operator*() const { return get(); }
+  const T* operator->() const { return &get(); }
+};
+
+}
+
+#endif
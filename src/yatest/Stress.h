@@ -0,0 +1,418 @@
+#ifndef YATEST_STRESS_H_
+#define YATEST_STRESS_H_
+
+#include "TestRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define YATEST_HAS_FORK 1
+#endif
+
+namespace yatest {
+
+struct StressOptions final {
+  // Number of runs of the selected suites, 0 for no limit.
+  uint64_t repeat = 0u;
+  // Stop after the first run in which a test failed.
+  bool untilFail = false;
+  // Do not start further runs after this many seconds, 0 for no limit.
+  double durationSeconds = 0.0;
+  // Number of processes sharing the runs. Each process has its own state of
+  // the mocks, so tests cannot interfere with each other (POSIX only, the
+  // runs are done in this process otherwise).
+  unsigned parallel = 1u;
+};
+
+namespace detail {
+
+/**
+ * Distribution of test durations in buckets of a 1/8 power of two (about 9%
+ * wide) from 10 ns up, which can be merged from multiple processes.
+ */
+class DurationHistogram final {
+  static constexpr double SMALLEST_MICROS = 0.01;
+  static constexpr int BUCKETS_PER_OCTAVE = 8;
+  static constexpr int BUCKETS = 32 * BUCKETS_PER_OCTAVE;
+
+  std::vector<uint32_t> _counts {};
+
+  static double upperBound(int bucket) {
+    return SMALLEST_MICROS * std::exp2(static_cast<double>(bucket + 1) / BUCKETS_PER_OCTAVE);
+  }
+
+public:
+  void add(double micros, uint32_t count = 1u) {
+    int bucket = micros > SMALLEST_MICROS ? static_cast<int>(std::log2(micros / SMALLEST_MICROS) * BUCKETS_PER_OCTAVE) : 0;
+    add(bucket < BUCKETS ? bucket : BUCKETS - 1, count);
+  }
+
+  void add(int bucket, uint32_t count) {
+    if (_counts.empty()) {
+      _counts.resize(BUCKETS, 0u);
+    }
+    if (bucket >= 0 && bucket < BUCKETS) {
+      _counts[bucket] += count;
+    }
+  }
+
+  const std::vector<uint32_t>& counts() const {
+    return _counts;
+  }
+
+  // Upper bound of the bucket containing the given quantile (0 to 1).
+  double quantile(double q, uint64_t total) const {
+    uint64_t target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    uint64_t seen = 0u;
+    for (int bucket = 0; bucket < static_cast<int>(_counts.size()); ++bucket) {
+      seen += _counts[bucket];
+      if (seen >= target && seen > 0u) {
+        return upperBound(bucket);
+      }
+    }
+    return 0.0;
+  }
+};
+
+struct StressTestStats final {
+  std::string name;
+  uint64_t passed = 0u;
+  uint64_t failed = 0u;
+  uint64_t firstFailedRun = std::numeric_limits<uint64_t>::max();
+  std::string firstFailure {};
+  double minMicros = std::numeric_limits<double>::infinity();
+  double maxMicros = 0.0;
+  double totalMicros = 0.0;
+  DurationHistogram histogram {};
+
+  explicit StressTestStats(std::string name) : name(std::move(name)) {}
+
+  uint64_t runs() const {
+    return passed + failed;
+  }
+
+  void add(uint64_t run, const TestResult& result) {
+    if (result.status == TestStatus::Passed) {
+      passed += 1u;
+    } else {
+      failed += 1u;
+      if (run < firstFailedRun) {
+        firstFailedRun = run;
+        firstFailure = result.what;
+      }
+    }
+    minMicros = std::min(minMicros, result.durationMicros);
+    maxMicros = std::max(maxMicros, result.durationMicros);
+    totalMicros += result.durationMicros;
+    histogram.add(result.durationMicros);
+  }
+
+  void merge(const StressTestStats& other) {
+    passed += other.passed;
+    failed += other.failed;
+    if (other.firstFailedRun < firstFailedRun) {
+      firstFailedRun = other.firstFailedRun;
+      firstFailure = other.firstFailure;
+    }
+    minMicros = std::min(minMicros, other.minMicros);
+    maxMicros = std::max(maxMicros, other.maxMicros);
+    totalMicros += other.totalMicros;
+    const auto& counts = other.histogram.counts();
+    for (int bucket = 0; bucket < static_cast<int>(counts.size()); ++bucket) {
+      if (counts[bucket] > 0u) {
+        histogram.add(bucket, counts[bucket]);
+      }
+    }
+  }
+
+  // One line: counts, durations, non-empty buckets, then the length prefixed name and failure.
+  void write(std::ostream& out) const {
+    out << passed << " " << failed << " " << firstFailedRun << " " << std::setprecision(17)
+        << minMicros << " " << maxMicros << " " << totalMicros;
+    const auto& counts = histogram.counts();
+    std::size_t used = std::count_if(counts.begin(), counts.end(), [](uint32_t count) { return count > 0u; });
+    out << " " << used;
+    for (std::size_t bucket = 0u; bucket < counts.size(); ++bucket) {
+      if (counts[bucket] > 0u) {
+        out << " " << bucket << " " << counts[bucket];
+      }
+    }
+    out << " " << name.size() << ":" << name << firstFailure.size() << ":" << firstFailure << "\n";
+  }
+
+  static bool readString(std::istream& in, std::string& text) {
+    std::size_t length = 0u;
+    if (!(in >> length) || in.get() != ':') {
+      return false;
+    }
+    text.resize(length);
+    return static_cast<bool>(in.read(&text[0], static_cast<std::streamsize>(length)));
+  }
+
+  bool read(std::istream& in) {
+    std::size_t used = 0u;
+    if (!(in >> passed >> failed >> firstFailedRun >> minMicros >> maxMicros >> totalMicros >> used)) {
+      return false;
+    }
+    for (std::size_t i = 0u; i < used; ++i) {
+      int bucket = 0;
+      uint32_t count = 0u;
+      if (!(in >> bucket >> count)) {
+        return false;
+      }
+      histogram.add(bucket, count);
+    }
+    in.get();
+    return readString(in, name) && readString(in, firstFailure);
+  }
+};
+
+struct StressSuiteStats final {
+  std::vector<StressTestStats> tests {};
+  std::unordered_map<const char*, std::size_t> byName {}; // Names of one process are stable pointers
+
+  StressTestStats& test(const char* name) {
+    auto found = byName.find(name);
+    if (found != byName.end()) {
+      return tests[found->second];
+    }
+    byName.emplace(name, tests.size());
+    tests.emplace_back(name);
+    return tests.back();
+  }
+
+  void merge(const StressTestStats& other) {
+    for (StressTestStats& test : tests) {
+      if (test.name == other.name) {
+        test.merge(other);
+        return;
+      }
+    }
+    tests.push_back(other);
+  }
+};
+
+// Progress shared by all processes (placed in shared memory when forking).
+struct StressControl final {
+  std::atomic<uint64_t> nextRun { 0u };
+  std::atomic<bool> stop { false };
+};
+
+/**
+ * Run the suites over and over until one of the limits is reached, adding
+ * the results of each test to stats (indexed like suites).
+ */
+inline void stressLoop(const std::vector<ITestSuite*>& suites, const RunOptions& options, const StressOptions& stress,
+                       std::chrono::steady_clock::time_point deadline, StressControl& control,
+                       std::vector<StressSuiteStats>& stats, uint64_t seed) {
+  std::mt19937_64 random { seed };
+  std::vector<std::size_t> suiteOrder(suites.size());
+  std::iota(suiteOrder.begin(), suiteOrder.end(), 0u);
+  while (!control.stop.load(std::memory_order_relaxed)) {
+    if (stress.durationSeconds > 0.0 && std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+    uint64_t run = control.nextRun.fetch_add(1u, std::memory_order_relaxed);
+    if (stress.repeat > 0u && run >= stress.repeat) {
+      break;
+    }
+    if (options.shuffle) {
+      std::shuffle(suiteOrder.begin(), suiteOrder.end(), random);
+    }
+    bool failed = false;
+    for (std::size_t index : suiteOrder) {
+      ITestSuite* suite = suites[index];
+      TestSuiteResult result {};
+      if (options.shuffle) {
+        std::vector<std::size_t> order(suite->testNames().size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::shuffle(order.begin(), order.end(), random);
+        result = order.empty() ? suite->run() : suite->runInOrder(order);
+      } else {
+        result = suite->run();
+      }
+      for (const TestResult& test : result.testResults()) {
+        stats[index].test(test.name).add(run, test);
+        failed = failed || test.status == TestStatus::Failed;
+      }
+    }
+    if (failed && stress.untilFail) {
+      control.stop.store(true, std::memory_order_relaxed);
+    }
+  }
+}
+
+inline std::ostream& printDistribution(std::ostream& out, const StressTestStats& test) {
+  uint64_t runs = test.runs();
+  if (runs == 0u) {
+    return out;
+  }
+  // Bucket bounds are clamped to the exact extremes
+  auto quantile = [&](double q) { return std::max(test.minMicros, std::min(test.maxMicros, test.histogram.quantile(q, runs))); };
+  return out << std::fixed << std::setprecision(1) << " (mean " << test.totalMicros / static_cast<double>(runs)
+             << " µs, min " << test.minMicros << " µs, p50 " << quantile(0.5) << " µs, p90 " << quantile(0.9)
+             << " µs, p99 " << quantile(0.99) << " µs, max " << test.maxMicros << " µs)";
+}
+
+}
+
+/**
+ * Run the selected suites repeatedly (to find flaky tests) and report, per
+ * test, how often it passed and the distribution of its durations. Cached
+ * suites are run as well, and no results or history files are written.
+ *
+ * Returns the number of tests which failed at least once.
+ */
+inline int stress(const RunOptions& options, const StressOptions& stress) {
+  using DurationSeconds = std::chrono::duration<double>;
+  std::vector<ITestSuite*> suites = selectSuites(options);
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(DurationSeconds(stress.durationSeconds));
+  std::vector<detail::StressSuiteStats> stats(suites.size());
+  unsigned processes = 1u;
+  unsigned crashed = 0u;
+  bool forked = false;
+
+#ifdef YATEST_HAS_FORK
+  if (stress.parallel > 1u) {
+    void* memory = mmap(nullptr, sizeof(detail::StressControl), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+      auto* control = new (memory) detail::StressControl {};
+      std::cout.flush();
+      std::vector<std::pair<pid_t, int>> workers {};
+      for (unsigned k = 0u; k < stress.parallel; ++k) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+          break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+          close(fds[0]);
+          std::vector<detail::StressSuiteStats> workerStats(suites.size());
+          detail::stressLoop(suites, options, stress, deadline, *control, workerStats, options.seed + k);
+          std::ostringstream out {};
+          for (std::size_t index = 0u; index < workerStats.size(); ++index) {
+            for (const auto& test : workerStats[index].tests) {
+              out << index << " ";
+              test.write(out);
+            }
+          }
+          std::cout.flush();
+          const std::string& data = out.str();
+          for (std::size_t written = 0u; written < data.size();) {
+            ssize_t count = ::write(fds[1], data.data() + written, data.size() - written);
+            if (count <= 0) {
+              break;
+            }
+            written += static_cast<std::size_t>(count);
+          }
+          _exit(0);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+          close(fds[0]);
+          break;
+        }
+        workers.emplace_back(pid, fds[0]);
+      }
+      for (const auto& worker : workers) {
+        std::string data {};
+        char buffer[4096];
+        ssize_t count = 0;
+        while ((count = ::read(worker.second, buffer, sizeof(buffer))) > 0) {
+          data.append(buffer, static_cast<std::size_t>(count));
+        }
+        close(worker.second);
+        std::istringstream in { data };
+        std::size_t index = 0u;
+        while (in >> index) {
+          detail::StressTestStats test { "" };
+          if (!test.read(in) || index >= stats.size()) {
+            break;
+          }
+          stats[index].merge(test);
+        }
+        int status = 0;
+        if (waitpid(worker.first, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          crashed += 1u;
+        }
+      }
+      processes = static_cast<unsigned>(workers.size());
+      forked = !workers.empty();
+      munmap(memory, sizeof(detail::StressControl));
+    }
+  }
+#endif
+  if (!forked) {
+    detail::StressControl control {};
+    detail::stressLoop(suites, options, stress, deadline, control, stats, options.seed);
+  }
+  // Each run runs every test once
+  uint64_t completedRuns = 0u;
+  for (const auto& suite : stats) {
+    for (const auto& test : suite.tests) {
+      completedRuns = std::max(completedRuns, test.runs());
+    }
+  }
+  double seconds = DurationSeconds(std::chrono::steady_clock::now() - start).count();
+
+  std::size_t stable = 0u;
+  std::size_t flaky = 0u;
+  std::size_t failing = 0u;
+  std::ostringstream out {};
+  for (std::size_t index = 0u; index < suites.size(); ++index) {
+    out << "Running " << Colored { "\033[1;36m", suites[index]->name() } << " [\n";
+    for (const auto& test : stats[index].tests) {
+      if (test.failed == 0u) {
+        stable += 1u;
+        out << "  " << Colored { "\033[0;32m", "PASS" } << " " << test.name;
+      } else if (test.passed > 0u) {
+        flaky += 1u;
+        out << "  " << Colored { "\033[0;33m", "FLAKY" } << " " << test.name;
+      } else {
+        failing += 1u;
+        out << "  " << Colored { "\033[0;31m", "FAIL" } << " " << test.name;
+      }
+      out << " " << test.passed << "/" << test.runs() << " passed";
+      if (test.failed > 0u) {
+        out << ", first failed in run " << test.firstFailedRun + 1u << " (" << test.firstFailure << ")";
+      }
+      detail::printDistribution(out, test) << "\n";
+    }
+    out << "]\n";
+  }
+  out << "\nTotal: " << completedRuns << " runs in " << std::fixed << std::setprecision(1) << seconds << " s";
+  if (processes > 1u) {
+    out << " (" << processes << " processes)";
+  }
+  out << ": " << stable << " stable, " << flaky << " flaky, " << failing << " always failing";
+  if (options.shuffle) {
+    out << ", shuffled with --seed " << options.seed;
+  }
+  out << "\n";
+  if (crashed > 0u) {
+    out << Colored { "\033[0;31m", "Crashed" } << ": " << crashed << " of " << processes << " processes did not finish, their results are missing\n";
+  }
+  std::cout << out.str() << std::flush;
+  return static_cast<int>(flaky + failing + crashed);
+}
+
+}
+
+#endif
@@ -2,9 +2,23 @@
 #define YATEST_TESTRUNNER_H_
 
 #include "TestSuite.h"
+#include "History.h"
+#include "Reporter.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <numeric>
+#include <random>
 #include <string>
+#include <vector>
+
+// Name of the build profile the tests were compiled with (set by build-and-run.sh),
+// reported along with the timings.
+#ifndef YATEST_BUILD_PROFILE
+#define YATEST_BUILD_PROFILE ""
+#endif
 
 namespace yatest {
 
@@ -24,53 +38,251 @@ inline std::string colorize(const char* code, const std::string& text) {
   return std::string(code) + text + "\033[0m";
 }
 
+// Colored text written without building temporary strings (out << Colored { code, text }).
+struct Colored final {
+  const char* code;
+  const char* text;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Colored& colored) {
+  if (!useColorOutput()) {
+    return out << colored.text;
+  }
+  return out << colored.code << colored.text << "\033[0m";
+}
+
+inline std::ostream& printDuration(std::ostream& out, double durationMicros, double setupMicros) {
+  out << " (" << std::fixed << std::setprecision(1) << durationMicros << " µs";
+  if (setupMicros > 0.0) {
+    out << ", setup " << setupMicros << " µs";
+  }
+  return out << ")";
+}
+
+inline std::ostream& printMetricList(std::ostream& out, const std::vector<TestMetric>& metrics) {
+  for (std::size_t i = 0u; i < metrics.size(); ++i) {
+    out << (i > 0u ? ", " : "") << metrics[i].name << " "
+        << std::fixed << std::setprecision(1) << metrics[i].value << " " << metrics[i].unit;
+  }
+  return out;
+}
+
+inline std::ostream& printMetrics(std::ostream& out, const std::vector<TestMetric>& metrics) {
+  if (metrics.empty()) {
+    return out;
+  }
+  out << " [";
+  return printMetricList(out, metrics) << "]";
+}
+
+// Add metrics to the totals of metrics with the same name.
+inline void addMetrics(std::vector<TestMetric>& totals, const std::vector<TestMetric>& metrics) {
+  for (auto& metric : metrics) {
+    auto total = std::find_if(totals.begin(), totals.end(), [&](const TestMetric& t) { return t.name == metric.name; });
+    if (total == totals.end()) {
+      totals.push_back(metric);
+    } else {
+      total->value += metric.value;
+    }
+  }
+}
+
+struct RunOptions final {
+  // Only run suites defined in these source files (in the given order). All
+  // suites are run in registration order if empty.
+  std::vector<std::string> files {};
+  // Report suites defined in these source files as cached instead of running
+  // them (their inputs are known to be unchanged since they last passed).
+  std::vector<std::string> cachedFiles {};
+  // If set, write one "<passed|failed|cached>\t<file>\t<suite>" line per suite
+  // into this file.
+  std::string resultsFile {};
+  // Format and write the report on a background thread (see yatest::Reporter).
+  // Output of the tests themselves may be interleaved differently then.
+  bool asyncOutput = true;
+  // If set, record a trace of the run and write it into this file (see
+  // yatest::trace).
+  std::string traceFile {};
+  // If set, read durations and outcomes of previous runs from this file and
+  // run suites with recently failed tests first, the others in their order
+  // (see yatest::TestHistory). The file is updated with this run, without
+  // tests which are no longer registered.
+  std::string historyFile {};
+  // Run suites, and the tests within each suite, in a random order given by
+  // the seed instead (to find tests which depend on other tests running
+  // before them).
+  bool shuffle = false;
+  uint64_t seed = 0u;
+};
+
 /**
- * Run all test suites currently listed in yatest::TestSuites and output the
- * results on standard output.
+ * Select the suites to run according to the given options.
+ */
+inline std::vector<ITestSuite*> selectSuites(const RunOptions& options) {
+  std::vector<ITestSuite*> selected {};
+  selected.reserve(TestSuites.size());
+  if (options.files.empty()) {
+    for (auto& suite : TestSuites) {
+      selected.push_back(suite);
+    }
+  } else {
+    for (auto& file : options.files) {
+      for (auto& suite : TestSuites) {
+        if (file == suite->file() && std::find(selected.begin(), selected.end(), suite) == selected.end()) {
+          selected.push_back(suite);
+        }
+      }
+    }
+  }
+  return selected;
+}
+
+/**
+ * Run all selected test suites currently listed in yatest::TestSuites and
+ * output the results on standard output.
  * 
  * Returns the total number of failed tests, i.e. zero if all tests were
  * passed.
  */
-int run() {
+inline int run(const RunOptions& options) {
   size_t totalPassed = 0u;
   size_t totalFailed = 0u;
+  size_t totalCached = 0u;
   double totalDurationMicros = 0.0;
-  
-  for (auto& suite : yatest::TestSuites) {
-    std::cout << "Running "
-              << colorize("\033[1;36m", suite->name())
-              << " [" << std::endl;
-    auto result = suite->run();
+  std::vector<TestMetric> totalMetrics {};
+
+  // Only written by the reporter (i.e. from its thread)
+  std::ofstream results {};
+  if (!options.resultsFile.empty()) {
+    results.open(options.resultsFile, std::ios::out | std::ios::trunc);
+  }
+  Reporter reporter { options.asyncOutput };
+  if (!options.traceFile.empty()) {
+    trace::start();
+  }
+
+  TestHistory history {};
+  if (!options.historyFile.empty()) {
+    history.load(options.historyFile);
+  }
+  std::mt19937_64 random { options.seed };
+  std::vector<ITestSuite*> suites = selectSuites(options);
+  if (options.shuffle) {
+    std::shuffle(suites.begin(), suites.end(), random);
+  } else if (!options.historyFile.empty()) {
+    history.orderSuites(suites);
+  }
+
+  for (auto suite : suites) {
+    const auto& cachedFiles = options.cachedFiles;
+    if (std::find(cachedFiles.begin(), cachedFiles.end(), suite->file()) != cachedFiles.end()) {
+      totalCached += 1u;
+      reporter.report([suite, &results](std::ostream& out) {
+        out << "Cached " << Colored { "\033[1;36m", suite->name() } << " (unchanged since last passed)\n";
+        if (results.is_open()) {
+          results << "cached\t" << suite->file() << "\t" << suite->name() << "\n";
+        }
+      });
+      continue;
+    }
+
+    reporter.report([suite](std::ostream& out) {
+      out << "Running " << Colored { "\033[1;36m", suite->name() } << " [\n";
+    });
+    reporter.drain();
+    std::vector<std::size_t> order {};
+    if (options.shuffle) {
+      order.resize(suite->testNames().size());
+      std::iota(order.begin(), order.end(), 0u);
+      std::shuffle(order.begin(), order.end(), random);
+    }
+    auto result = order.empty() ? suite->run() : suite->runInOrder(order);
+    if (!options.historyFile.empty()) {
+      history.record(*suite, result);
+    }
     for (auto& testResult : result.testResults()) {
-      switch (testResult.status)
-      {
-      case yatest::TestStatus::Passed:
+      if (testResult.status == TestStatus::Passed) {
         totalPassed += 1u;
-        std::cout << "  " << colorize("\033[0;32m", "PASS") << " " << testResult.name
-                  << " (" << std::fixed << std::setprecision(1) << testResult.durationMicros << " µs)"
-                  << std::endl;
-        break;
-      case yatest::TestStatus::Failed:
+      } else {
         totalFailed += 1u;
-        std::cout << "  " << colorize("\033[0;31m", "FAIL") << " " << testResult.name << " (" << testResult.what << ")"
-                  << " (" << std::fixed << std::setprecision(1) << testResult.durationMicros << " µs)"
-                  << std::endl;
-        break;
       }
+      addMetrics(totalMetrics, testResult.metrics);
     }
     totalDurationMicros += result.durationMicros();
-    std::cout << "] "
-              << "(" << std::fixed << std::setprecision(1) << result.durationMicros() << " µs)"
-              << std::endl;
+
+    reporter.report([suite, result = std::move(result), &results](std::ostream& out) {
+      bool suitePassed = true;
+      for (auto& testResult : result.testResults()) {
+        switch (testResult.status)
+        {
+        case yatest::TestStatus::Passed:
+          out << "  " << Colored { "\033[0;32m", "PASS" } << " " << testResult.name;
+          printDuration(out, testResult.durationMicros, testResult.setupMicros);
+          printMetrics(out, testResult.metrics) << "\n";
+          break;
+        case yatest::TestStatus::Failed:
+          suitePassed = false;
+          out << "  " << Colored { "\033[0;31m", "FAIL" } << " " << testResult.name << " (" << testResult.what << ")";
+          printDuration(out, testResult.durationMicros, testResult.setupMicros);
+          printMetrics(out, testResult.metrics) << "\n";
+          break;
+        }
+      }
+      out << "]";
+      printDuration(out, result.durationMicros(), result.setupMicros()) << "\n";
+      if (results.is_open()) {
+        results << (suitePassed ? "passed" : "failed") << "\t" << suite->file() << "\t" << suite->name() << "\n";
+      }
+    });
   }
 
-  std::cout << "\nTotal: " << totalPassed << " passed, " << totalFailed  << " failed"
-            << " (" << std::fixed << std::setprecision(1) << totalDurationMicros << " µs)"
-            << std::endl;
+  reporter.report([=, shuffle = options.shuffle, seed = options.seed](std::ostream& out) {
+    out << "\nTotal: " << totalPassed << " passed, " << totalFailed  << " failed";
+    if (totalCached > 0u) {
+      out << ", " << totalCached << " suites cached";
+    }
+    if (shuffle) {
+      out << ", shuffled with --seed " << seed;
+    }
+    out << " (" << std::fixed << std::setprecision(1) << totalDurationMicros << " µs";
+    if (*YATEST_BUILD_PROFILE != '\0') {
+      out << ", " << YATEST_BUILD_PROFILE << " build";
+    }
+    out << ")\n";
+    if (!totalMetrics.empty()) {
+      out << "Metrics: ";
+      printMetricList(out, totalMetrics) << "\n";
+    }
+  });
+  reporter.finish();
+
+  if (!options.historyFile.empty()) {
+    history.prune(TestSuites);
+    if (!history.save(options.historyFile)) {
+      std::cerr << "Failed to write test history to " << options.historyFile << std::endl;
+    }
+  }
+  if (!options.traceFile.empty()) {
+    trace::stop();
+    if (!trace::write(options.traceFile.c_str())) {
+      std::cerr << "Failed to write trace to " << options.traceFile << std::endl;
+    }
+  }
 
   return totalFailed;
 }
 
+/**
+ * Run all test suites currently listed in yatest::TestSuites and output the
+ * results on standard output.
+ * 
+ * Returns the total number of failed tests, i.e. zero if all tests were
+ * passed.
+ */
+inline int run() {
+  return run(RunOptions {});
+}
+
 }
 
 #endif
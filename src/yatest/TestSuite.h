@@ -1,11 +1,18 @@
 #ifndef YATEST_TESTSUITE_H_
 #define YATEST_TESTSUITE_H_
 
+#include "Trace.h"
 #include <vector>
-#include <functional>
-#include <memory>
 #include <string>
 #include <chrono>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace yatest {
 
@@ -14,53 +21,342 @@ enum struct TestStatus {
   Failed
 };
 
+/**
+ * Additional measurement of a test run, recorded by a test probe (see
+ * yatest::addTestProbe()).
+ */
+struct TestMetric final {
+  std::string name;
+  double value;
+  const char* unit;
+};
+
 struct TestResult final {
   const char* name;
   TestStatus status;
   std::string what;
   double durationMicros;
+  double setupMicros;
+  std::vector<TestMetric> metrics {};
 
-  TestResult(const char* name, TestStatus status, std::string what, double durationMicros)
-      : name(name), status(status), what(what), durationMicros(durationMicros) {}
+  TestResult(const char* name, TestStatus status, std::string what, double durationMicros, double setupMicros = 0.0)
+      : name(name), status(status), what(what), durationMicros(durationMicros), setupMicros(setupMicros) {}
 };
 
 class TestSuiteResult final {
   std::vector<TestResult> _testResults {};
   double _durationMicros = 0.0;
+  double _setupMicros = 0.0;
 
 public:
   const std::vector<TestResult>& testResults() const { return _testResults; }
   double durationMicros() const { return _durationMicros; }
   void setDurationMicros(double durationMicros) { _durationMicros = durationMicros; }
+  double setupMicros() const { return _setupMicros; }
+  void setSetupMicros(double setupMicros) { _setupMicros = setupMicros; }
 
-  void passed(const char* name, double durationMicros) {
-    _testResults.emplace_back(name, TestStatus::Passed, "", durationMicros);
+  void reserve(std::size_t count) {
+    _testResults.reserve(count);
   }
 
-  void failed(const char* name, double durationMicros) {
-    failed(name, "", durationMicros);
+  TestResult& passed(const char* name, double durationMicros, double setupMicros = 0.0) {
+    _testResults.emplace_back(name, TestStatus::Passed, "", durationMicros, setupMicros);
+    return _testResults.back();
   }
 
-  void failed(const char* name, const char* what, double durationMicros) {
-    _testResults.emplace_back(name, TestStatus::Failed, what, durationMicros);
+  TestResult& failed(const char* name, double durationMicros, double setupMicros = 0.0) {
+    return failed(name, "", durationMicros, setupMicros);
+  }
+
+  TestResult& failed(const char* name, const char* what, double durationMicros, double setupMicros = 0.0) {
+    _testResults.emplace_back(name, TestStatus::Failed, what, durationMicros, setupMicros);
+    return _testResults.back();
   }
 };
 
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define YATEST_CALLER_FILE __builtin_FILE()
+#else
+#define YATEST_CALLER_FILE ""
+#endif
+
 struct ITestSuite {
   virtual ~ITestSuite() {}
   virtual const char* name() const = 0;
   virtual TestSuiteResult run() = 0;
+
+  // Source file which defined the suite (used to select and cache suites per file).
+  virtual const char* file() const { return ""; }
+
+  // Names of the tests in registration order, if the suite can run them in a
+  // different order (see runInOrder()).
+  virtual std::vector<const char*> testNames() const { return {}; }
+
+  // Run the tests in the given order (indices into testNames()).
+  virtual TestSuiteResult runInOrder(const std::vector<std::size_t>& order) {
+    (void)order;
+    return run();
+  }
+
+  // Intrusive link used by TestSuiteList, see yatest::TestSuites.
+  ITestSuite* nextSuite = nullptr;
+};
+
+/**
+ * Measures each test run, e.g. by counting calls or reading counters before
+ * and after it. Probes are invoked right around the test body (fixture hooks
+ * are not included) and add their measurements to the result of the test.
+ */
+struct ITestProbe {
+  virtual ~ITestProbe() {}
+  virtual void beforeTest() = 0;
+  virtual void afterTest(std::vector<TestMetric>& metrics) = 0;
+};
+
+namespace detail {
+
+inline std::vector<ITestProbe*>& testProbes() {
+  static std::vector<ITestProbe*> probes {};
+  return probes;
+}
+
+/**
+ * Bump allocator for objects which are registered during static
+ * initialization and live until the program exits (test suites, test cases
+ * and their callables).
+ *
+ * Memory is taken from a static block first and from large chunks on the heap
+ * afterwards, so registering thousands of tests costs only a handful of heap
+ * allocations. Registered objects are never released; only code which
+ * registers temporary suites (like a benchmark of registration) rewinds the
+ * arena to a mark taken before.
+ */
+class Arena final {
+  static constexpr std::size_t ChunkSize = 64u * 1024u;
+
+  // Header of a heap chunk, the chunks form a list (latest first).
+  struct Chunk {
+    Chunk* previous;
+  };
+
+  unsigned char* _block;
+  std::size_t _capacity;
+  std::size_t _used = 0u;
+  Chunk* _chunks = nullptr;
+
+public:
+  struct Mark {
+    unsigned char* block;
+    std::size_t capacity;
+    std::size_t used;
+    Chunk* chunks;
+  };
+
+  constexpr Arena(unsigned char* block, std::size_t capacity) : _block(block), _capacity(capacity) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(std::size_t size, std::size_t alignment) {
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(_block);
+    std::size_t offset = ((base + _used + alignment - 1u) & ~(std::uintptr_t(alignment) - 1u)) - base;
+    if (offset + size > _capacity) {
+      _capacity = size + alignment > ChunkSize ? size + alignment : ChunkSize;
+      Chunk* chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + _capacity));
+      chunk->previous = _chunks;
+      _chunks = chunk;
+      _block = reinterpret_cast<unsigned char*>(chunk + 1);
+      base = reinterpret_cast<std::uintptr_t>(_block);
+      offset = ((base + alignment - 1u) & ~(std::uintptr_t(alignment) - 1u)) - base;
+    }
+    _used = offset + size;
+    return _block + offset;
+  }
+
+  Mark mark() const {
+    return Mark { _block, _capacity, _used, _chunks };
+  }
+
+  /**
+   * Release everything allocated after the mark (without destroying it) and
+   * free the heap chunks taken since.
+   */
+  void rewind(const Mark& mark) {
+    while (_chunks != mark.chunks) {
+      Chunk* previous = _chunks->previous;
+      ::operator delete(_chunks);
+      _chunks = previous;
+    }
+    _block = mark.block;
+    _capacity = mark.capacity;
+    _used = mark.used;
+  }
+
+  template<typename T, typename... Args>
+  T* create(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+};
+
+inline Arena& arena() {
+  alignas(std::max_align_t) static unsigned char initialBlock[16u * 1024u];
+  static Arena instance { initialBlock, sizeof(initialBlock) };
+  return instance;
+}
+
+/**
+ * Type-erased callable without arguments: a function pointer plus the context
+ * (the stored callable object) it is invoked with.
+ */
+struct Callable final {
+  void (*invoke)(void* context) = nullptr;
+  void* context = nullptr;
+
+  explicit operator bool() const {
+    return invoke != nullptr;
+  }
+
+  void operator()() const {
+    invoke(context);
+  }
+
+  template<typename F>
+  static Callable create(F&& callable) {
+    using Stored = typename std::decay<F>::type;
+    Callable result;
+    result.invoke = [](void* c) { (*static_cast<Stored*>(c))(); };
+    result.context = arena().create<Stored>(std::forward<F>(callable));
+    return result;
+  }
+};
+
+// Suites registered with TestSuites.emplace_back() (stable addresses).
+inline std::deque<std::unique_ptr<ITestSuite>>& ownedSuites() {
+  static std::deque<std::unique_ptr<ITestSuite>> suites {};
+  return suites;
+}
+
+/**
+ * Time spent constructing lazily shared fixture state (see yatest::Shared) on
+ * the current thread. TestSuite uses it to move that time from the test
+ * duration to the setup duration.
+ */
+inline double& sharedSetupMicros() {
+  thread_local double micros = 0.0;
+  return micros;
+}
+
+}
+
+/**
+ * A single registered test. Test cases of a suite form an intrusive list.
+ */
+struct TestCase final {
+  const char* name;
+  detail::Callable test;
+  TestCase* next = nullptr;
+
+  TestCase(const char* name, detail::Callable test) : name(name), test(test) {}
+
+  void operator()() const {
+    test();
+  }
 };
 
 class TestSuite final : public ITestSuite {
+  using Clock = std::chrono::steady_clock;
+  using DurationMicros = std::chrono::duration<double, std::micro>;
+
   const char* _name;
-  std::vector<std::pair<const char*, std::function<void()>>> _tests {};
+  const char* _file;
+  TestCase* _firstTest = nullptr;
+  TestCase* _lastTest = nullptr;
+  std::size_t _testCount = 0u;
+  detail::Callable _beforeAll {};
+  detail::Callable _afterAll {};
+  detail::Callable _beforeEach {};
+  detail::Callable _afterEach {};
+
+  /**
+   * Invoke a fixture hook (if set), add the time it took to setupMicros and
+   * return an error message if it failed (empty if it succeeded).
+   */
+  static std::string runHook(const detail::Callable& hook, const char* hookName, double& setupMicros) {
+    if (!hook) {
+      return {};
+    }
+    std::string error {};
+    auto traced = trace::scope(hookName, "fixture");
+    auto start = Clock::now();
+    try {
+      hook();
+    } catch (std::exception& e) {
+      error = std::string(hookName) + " failed: " + e.what();
+    } catch (...) {
+      error = std::string(hookName) + " failed";
+    }
+    setupMicros += DurationMicros(Clock::now() - start).count();
+    return error;
+  }
 
 public:
-  TestSuite(const char* name) : _name(name) {}
+  TestSuite(const char* name, const char* file = "") : _name(name), _file(file) {}
+
+  /**
+   * Add a test case to this suite. The callable (lambda, function or any
+   * other invocable without arguments) is stored once and invoked in place
+   * when the suite is run.
+   */
+  template<typename F>
+  TestSuite& tests(const char* name, F&& test) {
+    TestCase* testCase = detail::arena().create<TestCase>(name, detail::Callable::create(std::forward<F>(test)));
+    if (_lastTest == nullptr) {
+      _firstTest = testCase;
+    } else {
+      _lastTest->next = testCase;
+    }
+    _lastTest = testCase;
+    _testCount += 1u;
+    return *this;
+  }
+
+  /**
+   * Set a hook which is run once before the first test of this suite. If it
+   * fails, all tests of the suite are reported as failed without running them.
+   */
+  template<typename F>
+  TestSuite& beforeAll(F&& hook) {
+    _beforeAll = detail::Callable::create(std::forward<F>(hook));
+    return *this;
+  }
+
+  /**
+   * Set a hook which is run once after the last test of this suite. If it
+   * fails, an additional failed "afterAll" result is reported.
+   */
+  template<typename F>
+  TestSuite& afterAll(F&& hook) {
+    _afterAll = detail::Callable::create(std::forward<F>(hook));
+    return *this;
+  }
+
+  /**
+   * Set a hook which is run before each test of this suite. If it fails, the
+   * test is reported as failed without running it.
+   */
+  template<typename F>
+  TestSuite& beforeEach(F&& hook) {
+    _beforeEach = detail::Callable::create(std::forward<F>(hook));
+    return *this;
+  }
 
-  TestSuite& tests(const char* name, std::function<void()> test) {
-    _tests.emplace_back(std::make_pair(name, test));
+  /**
+   * Set a hook which is run after each test of this suite (also if the test
+   * or beforeEach failed). If it fails, the test is reported as failed.
+   */
+  template<typename F>
+  TestSuite& afterEach(F&& hook) {
+    _afterEach = detail::Callable::create(std::forward<F>(hook));
     return *this;
   }
 
@@ -68,36 +364,186 @@ public:
     return _name;
   }
 
+  const char* file() const override {
+    return _file;
+  }
+
+  std::size_t testCount() const {
+    return _testCount;
+  }
+
+  std::vector<const char*> testNames() const override {
+    std::vector<const char*> names {};
+    names.reserve(_testCount);
+    for (const TestCase* test = _firstTest; test != nullptr; test = test->next) {
+      names.push_back(test->name);
+    }
+    return names;
+  }
+
   TestSuiteResult run() override {
-    using Clock = std::chrono::steady_clock;
-    using DurationMicros = std::chrono::duration<double, std::micro>;
+    std::vector<const TestCase*> tests {};
+    tests.reserve(_testCount);
+    for (const TestCase* test = _firstTest; test != nullptr; test = test->next) {
+      tests.push_back(test);
+    }
+    return runTests(tests);
+  }
+
+  TestSuiteResult runInOrder(const std::vector<std::size_t>& order) override {
+    std::vector<const TestCase*> registered {};
+    registered.reserve(_testCount);
+    for (const TestCase* test = _firstTest; test != nullptr; test = test->next) {
+      registered.push_back(test);
+    }
+    std::vector<const TestCase*> tests {};
+    tests.reserve(order.size());
+    for (std::size_t index : order) {
+      if (index < registered.size()) {
+        tests.push_back(registered[index]);
+      }
+    }
+    return runTests(tests);
+  }
 
+private:
+  TestSuiteResult runTests(const std::vector<const TestCase*>& tests) {
     TestSuiteResult result;
+    result.reserve(tests.size());
+    double suiteSetupMicros = 0.0;
+    auto tracedSuite = trace::scope(_name, "suite");
     auto suiteStart = Clock::now();
-    for (auto [name, test] : _tests) {
-      auto testStart = Clock::now();
-      try {
-        test();
-        auto testEnd = Clock::now();
-        result.passed(name, DurationMicros(testEnd - testStart).count());
-      } catch (std::exception& e) {
-        auto testEnd = Clock::now();
-        result.failed(name, e.what(), DurationMicros(testEnd - testStart).count());
-      } catch (...) {
-        auto testEnd = Clock::now();
-        result.failed(name, DurationMicros(testEnd - testStart).count());
+    std::string suiteError = runHook(_beforeAll, "beforeAll", suiteSetupMicros);
+    for (const TestCase* test : tests) {
+      if (!suiteError.empty()) {
+        result.failed(test->name, suiteError.c_str(), 0.0);
+        continue;
       }
+      auto tracedTest = trace::scope(test->name, "test");
+      double setupMicros = 0.0;
+      std::string error = runHook(_beforeEach, "beforeEach", setupMicros);
+      bool passed = error.empty();
+      double testMicros = 0.0;
+      std::vector<TestMetric> metrics {};
+      if (passed) {
+        const auto& probes = detail::testProbes();
+        for (ITestProbe* probe : probes) {
+          probe->beforeTest();
+        }
+        double& sharedSetupMicros = detail::sharedSetupMicros();
+        sharedSetupMicros = 0.0;
+        auto testStart = Clock::now();
+        try {
+          (*test)();
+        } catch (std::exception& e) {
+          passed = false;
+          error = e.what();
+        } catch (...) {
+          passed = false;
+        }
+        testMicros = DurationMicros(Clock::now() - testStart).count() - sharedSetupMicros;
+        setupMicros += sharedSetupMicros;
+        for (auto probe = probes.rbegin(); probe != probes.rend(); ++probe) {
+          (*probe)->afterTest(metrics);
+        }
+      }
+      std::string afterError = runHook(_afterEach, "afterEach", setupMicros);
+      if (passed && !afterError.empty()) {
+        passed = false;
+        error = afterError;
+      }
+      TestResult& testResult = passed ? result.passed(test->name, testMicros, setupMicros)
+                                      : result.failed(test->name, error.c_str(), testMicros, setupMicros);
+      testResult.metrics = std::move(metrics);
+    }
+    std::string afterAllError = runHook(_afterAll, "afterAll", suiteSetupMicros);
+    if (!afterAllError.empty()) {
+      result.failed("afterAll", afterAllError.c_str(), 0.0);
     }
     auto suiteEnd = Clock::now();
+    result.setSetupMicros(suiteSetupMicros);
     result.setDurationMicros(DurationMicros(suiteEnd - suiteStart).count());
     return result;
   }
 };
 
-inline std::vector<std::unique_ptr<ITestSuite>> TestSuites = {};
+/**
+ * Intrusive list of all registered test suites in registration order.
+ *
+ * Iterating yields ITestSuite pointers, so `for (auto& suite : TestSuites)`
+ * followed by `suite->run()` works as before. Custom ITestSuite
+ * implementations can be registered with add(), they must outlive the test
+ * run (e.g. have static storage duration). Registering owned suites with
+ * emplace_back()/push_back(), as with the former
+ * std::vector<std::unique_ptr<ITestSuite>>, is still supported; other vector
+ * operations (indexing, erasing, clear()) are not.
+ */
+class TestSuiteList final {
+  ITestSuite* _first = nullptr;
+  ITestSuite* _last = nullptr;
+  std::size_t _size = 0u;
+
+public:
+  class iterator final {
+    ITestSuite* _current;
+
+  public:
+    explicit iterator(ITestSuite* current) : _current(current) {}
+    ITestSuite* const& operator*() const { return _current; }
+    iterator& operator++() { _current = _current->nextSuite; return *this; }
+    bool operator==(const iterator& other) const { return _current == other._current; }
+    bool operator!=(const iterator& other) const { return _current != other._current; }
+  };
+
+  constexpr TestSuiteList() {}
+
+  TestSuiteList(const TestSuiteList&) = delete;
+  TestSuiteList& operator=(const TestSuiteList&) = delete;
+
+  ITestSuite& add(ITestSuite& suite) {
+    suite.nextSuite = nullptr;
+    if (_last == nullptr) {
+      _first = &suite;
+    } else {
+      _last->nextSuite = &suite;
+    }
+    _last = &suite;
+    _size += 1u;
+    return suite;
+  }
+
+  // Register a suite owned by the list (kept until the program exits).
+  template<typename S>
+  std::unique_ptr<ITestSuite>& emplace_back(std::unique_ptr<S> suite) {
+    auto& owned = detail::ownedSuites();
+    owned.emplace_back(std::move(suite));
+    add(*owned.back());
+    return owned.back();
+  }
+
+  template<typename S>
+  void push_back(std::unique_ptr<S> suite) {
+    emplace_back(std::move(suite));
+  }
+
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0u; }
+  iterator begin() const { return iterator(_first); }
+  iterator end() const { return iterator(nullptr); }
+};
+
+inline TestSuiteList TestSuites {};
+
+/**
+ * Register a probe measuring all tests run afterwards. It must outlive the
+ * test run (e.g. have static storage duration).
+ */
+inline void addTestProbe(ITestProbe& probe) {
+  detail::testProbes().push_back(&probe);
+}
 
-inline TestSuite& suite(const char* name) {
-  return *static_cast<TestSuite*>(TestSuites.emplace_back(std::make_unique<TestSuite>(name)).get());
+inline TestSuite& suite(const char* name, const char* file = YATEST_CALLER_FILE) {
+  return static_cast<TestSuite&>(TestSuites.add(*detail::arena().create<TestSuite>(name, file)));
 }
 
 }
@@ -0,0 +1,253 @@
+#ifndef YATEST_TRACE_H_
+#define YATEST_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace yatest {
+namespace trace {
+
+/**
+ * Timeline of test execution in the Chrome Trace Event format (shown by
+ * chrome://tracing and https://ui.perfetto.dev): the test runner records
+ * suites, fixture hooks and tests, and any code can add its own scopes:
+ *
+ *   void parseFrame(...) {
+ *     auto traced = yatest::trace::scope("parseFrame");
+ *     ...
+ *   }
+ *
+ * Each scope is recorded with the wall time and, if a virtual clock is set
+ * (the runner uses the micros() of the Arduino mocks), the simulated time.
+ * Recording appends to a buffer of the current thread without locking and
+ * does nothing while tracing is stopped, so scopes can stay in the code.
+ */
+
+using VirtualClock = unsigned long (*)();
+
+namespace detail {
+
+struct Event final {
+  const char* name;
+  const char* category;
+  int64_t wallBegin; // ns since start()
+  int64_t wallEnd;
+  unsigned long virtualBegin;
+  unsigned long virtualEnd;
+};
+
+/**
+ * Events of one thread, in chunks which are never moved or released (they are
+ * reused when recording starts again). Only the owning thread appends; size is
+ * published with release semantics so events can be read after the fact from
+ * another thread.
+ */
+struct ThreadBuffer final {
+  static constexpr std::size_t ChunkSize = 4096u;
+
+  struct Chunk final {
+    Event events[ChunkSize];
+    Chunk* next = nullptr;
+  };
+
+  int threadIndex;
+  Chunk first {};
+  Chunk* last = &first;
+  std::size_t lastCount = 0u;
+  std::atomic<std::size_t> size { 0u };
+  ThreadBuffer* next = nullptr;
+
+  explicit ThreadBuffer(int threadIndex) : threadIndex(threadIndex) {}
+
+  void append(const Event& event) {
+    if (lastCount == ChunkSize) {
+      if (last->next == nullptr) {
+        last->next = new Chunk {};
+      }
+      last = last->next;
+      lastCount = 0u;
+    }
+    last->events[lastCount++] = event;
+    size.store(size.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+  }
+};
+
+struct State final {
+  std::atomic<bool> enabled { false };
+  std::chrono::steady_clock::time_point start {};
+  std::atomic<VirtualClock> virtualClock { nullptr };
+  std::atomic<ThreadBuffer*> buffers { nullptr };
+  std::atomic<int> threadCount { 0 };
+};
+
+inline State& state() {
+  static State instance {};
+  return instance;
+}
+
+// Buffer of the current thread, registered in the lock-free list of all
+// buffers on first use.
+inline ThreadBuffer& threadBuffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr) {
+    State& s = state();
+    buffer = new ThreadBuffer(s.threadCount.fetch_add(1));
+    ThreadBuffer* head = s.buffers.load(std::memory_order_relaxed);
+    do {
+      buffer->next = head;
+    } while (!s.buffers.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+  }
+  return *buffer;
+}
+
+inline int64_t wallNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().start).count();
+}
+
+inline unsigned long virtualMicros() {
+  VirtualClock clock = state().virtualClock.load(std::memory_order_relaxed);
+  return clock != nullptr ? clock() : 0u;
+}
+
+inline void writeEscaped(std::FILE* out, const char* text) {
+  for (const char* c = text; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      std::fputc('\\', out);
+      std::fputc(*c, out);
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      std::fprintf(out, "\\u%04x", static_cast<unsigned>(*c));
+    } else {
+      std::fputc(*c, out);
+    }
+  }
+}
+
+}
+
+inline bool enabled() {
+  return detail::state().enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Source of the simulated time recorded along with the wall time (e.g.
+ * `[]() { return micros(); }`), nullptr for none.
+ */
+inline void setVirtualClock(VirtualClock clock) {
+  detail::state().virtualClock.store(clock, std::memory_order_relaxed);
+}
+
+/**
+ * Start recording (again). Events recorded before are dropped, call this
+ * before any scope is active.
+ */
+inline void start() {
+  detail::State& s = detail::state();
+  s.start = std::chrono::steady_clock::now();
+  for (detail::ThreadBuffer* buffer = s.buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next) {
+    buffer->lastCount = 0u;
+    buffer->last = &buffer->first;
+    buffer->size.store(0u, std::memory_order_release);
+  }
+  s.enabled.store(true, std::memory_order_release);
+}
+
+inline void stop() {
+  detail::state().enabled.store(false, std::memory_order_release);
+}
+
+/**
+ * Marks a scope (from construction to destruction) on the timeline of the
+ * current thread. The name must outlive the trace (e.g. a string literal).
+ */
+class Scope final {
+  const char* _name;
+  const char* _category;
+  int64_t _wallBegin = 0;
+  unsigned long _virtualBegin = 0u;
+  bool _active;
+
+public:
+  explicit Scope(const char* name, const char* category = "scope") : _name(name), _category(category), _active(enabled()) {
+    if (_active) {
+      _virtualBegin = detail::virtualMicros();
+      _wallBegin = detail::wallNanos();
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+  ~Scope() {
+    if (_active) {
+      int64_t wallEnd = detail::wallNanos();
+      detail::threadBuffer().append(detail::Event { _name, _category, _wallBegin, wallEnd, _virtualBegin, detail::virtualMicros() });
+    }
+  }
+};
+
+[[nodiscard]] inline Scope scope(const char* name, const char* category = "scope") {
+  return Scope(name, category);
+}
+
+/**
+ * Write the recorded events as Chrome Trace Event JSON. The wall time
+ * timeline is process 1, the simulated time (if a virtual clock was set)
+ * process 2, each with a track per thread. Call this while no other thread
+ * is recording. Returns false if the file cannot be written.
+ */
+inline bool write(const char* path) {
+  std::FILE* out = std::fopen(path, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  detail::State& s = detail::state();
+  bool hasVirtualTime = s.virtualClock.load(std::memory_order_relaxed) != nullptr;
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", out);
+  std::fputs("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"wall time\"}}", out);
+  if (hasVirtualTime) {
+    std::fputs(",\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":2,\"args\":{\"name\":\"virtual time (micros())\"}}", out);
+  }
+  for (detail::ThreadBuffer* buffer = s.buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next) {
+    std::size_t remaining = buffer->size.load(std::memory_order_acquire);
+    for (int pid = 1; pid <= (hasVirtualTime ? 2 : 1); ++pid) {
+      std::fprintf(out, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                   pid, buffer->threadIndex, buffer->threadIndex);
+    }
+    for (const detail::ThreadBuffer::Chunk* chunk = &buffer->first; chunk != nullptr && remaining > 0u; chunk = chunk->next) {
+      std::size_t count = remaining < detail::ThreadBuffer::ChunkSize ? remaining : detail::ThreadBuffer::ChunkSize;
+      for (std::size_t i = 0u; i < count; ++i) {
+        const detail::Event& event = chunk->events[i];
+        std::fputs(",\n{\"ph\":\"X\",\"name\":\"", out);
+        detail::writeEscaped(out, event.name);
+        std::fputs("\",\"cat\":\"", out);
+        detail::writeEscaped(out, event.category);
+        std::fprintf(out, "\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", buffer->threadIndex,
+                     event.wallBegin / 1000.0, (event.wallEnd - event.wallBegin) / 1000.0);
+        if (hasVirtualTime) {
+          // A test may set the clock back (_test_micros) within a span
+          unsigned long virtualDuration = event.virtualEnd >= event.virtualBegin ? event.virtualEnd - event.virtualBegin : 0u;
+          std::fprintf(out, ",\"args\":{\"micros\":%lu,\"virtual duration\":%lu}}", event.virtualBegin, virtualDuration);
+          std::fputs(",\n{\"ph\":\"X\",\"name\":\"", out);
+          detail::writeEscaped(out, event.name);
+          std::fputs("\",\"cat\":\"", out);
+          detail::writeEscaped(out, event.category);
+          std::fprintf(out, "\",\"pid\":2,\"tid\":%d,\"ts\":%lu,\"dur\":%lu}", buffer->threadIndex,
+                       event.virtualBegin, virtualDuration);
+        } else {
+          std::fputs("}", out);
+        }
+      }
+      remaining -= count;
+    }
+  }
+  std::fputs("\n]}\n", out);
+  return std::fclose(out) == 0;
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef YATEST_WAITPROFILE_H_
+#define YATEST_WAITPROFILE_H_
+
+#include "TestSuite.h"
+#include "../Arduino.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace yatest {
+
+/**
+ * Test probe reporting the simulated time each test spent waiting: in delay(),
+ * delayMicroseconds() and Stream timeouts (e.g. a readStringUntil() for a
+ * terminator which never comes). The total is reported along with the call
+ * sites which waited longest, i.e. where the device would be slow or stall.
+ */
+class WaitProfileProbe final : public ITestProbe {
+  std::size_t _maxSites;
+
+  static const char* baseName(const char* path) {
+    const char* slash = std::strrchr(path, '/');
+    return slash != nullptr ? slash + 1 : path;
+  }
+
+  // The code address if there is no debug information for it
+  static std::string location(const MockWaitSite& site) {
+    if (site.line <= 0) {
+      char address[32];
+      std::snprintf(address, sizeof(address), "%p", site.address);
+      return address;
+    }
+    return std::string(baseName(site.file)) + ":" + std::to_string(site.line);
+  }
+
+public:
+  explicit WaitProfileProbe(std::size_t maxSites = 3u) : _maxSites(maxSites) {}
+
+  void beforeTest() override {
+    resetMockWaitProfile();
+  }
+
+  void afterTest(std::vector<TestMetric>& metrics) override {
+    std::vector<MockWaitSite> sites = getMockWaitProfile();
+    unsigned long long totalMicros = 0u;
+    for (const MockWaitSite& site : sites) {
+      totalMicros += site.micros;
+    }
+    if (totalMicros == 0u) {
+      return;
+    }
+    metrics.push_back(TestMetric { "waited", static_cast<double>(totalMicros), "µs" });
+    for (std::size_t i = 0u; i < sites.size() && i < _maxSites; ++i) {
+      std::string name = std::string(sites[i].kind) + " at " + location(sites[i]);
+      metrics.push_back(TestMetric { name, static_cast<double>(sites[i].micros), "µs" });
+    }
+  }
+};
+
+/**
+ * Report the simulated wait times for all tests run afterwards.
+ */
+inline void enableWaitProfile() {
+  static WaitProfileProbe probe {};
+  addTestProbe(probe);
+}
+
+}
+
+#endif